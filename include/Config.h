@@ -1,2 +1,4 @@
-#define SHADER_DIR "/home/amado/Projects/LearnOpenGL/shaders"
-#define TEXTURE_DIR "/home/amado/Projects/LearnOpenGL/textures"
+#define SHADER_DIR "/root/repo/shaders"
+#define TEXTURE_DIR "/root/repo/textures"
+#define GOLDEN_DIR "/root/repo/golden"
+#define HAVE_EGL
@@ -0,0 +1,43 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Small timing helpers shared by the benchmark executables.
+
+// keep the compiler from optimizing away a value nothing else reads
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+// fastest of repeats runs of iterations calls to fn, in nanoseconds per call;
+// the fastest run is the one least disturbed by the rest of the system
+template <typename F>
+inline double measure(F&& fn, size_t iterations, int repeats = 5) {
+  fn();  // warm up caches and lazy initialization
+  double best = 1e300;
+  for (int repeat = 0; repeat < repeats; repeat++) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+      fn();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+  }
+  return best;
+}
+
+// one result row: name, time per call and the speedup over baseline_ns if given
+inline void report(const std::string& name, double ns, double baseline_ns = 0.0) {
+  std::cout << "  " << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(12) << ns << " ns";
+  if (baseline_ns > 0.0)
+    std::cout << std::setw(9) << baseline_ns / ns << "x";
+  std::cout << std::defaultfloat << std::endl;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+
+// axis aligned bounding box, default constructed empty so it can be grown with expand()
+struct AABB {
+  glm::vec3 min = glm::vec3(FLT_MAX);
+  glm::vec3 max = glm::vec3(-FLT_MAX);
+
+  AABB() = default;
+  AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+  bool valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+  glm::vec3 center() const { return 0.5f * (min + max); }
+  glm::vec3 extent() const { return max - min; }
+
+  float surfaceArea() const {
+    if (!valid())
+      return 0.0f;
+    const glm::vec3 e = extent();
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+
+  void expand(const glm::vec3& point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  void expand(const AABB& box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+
+  bool overlaps(const AABB& box) const {
+    return min.x <= box.max.x && max.x >= box.min.x &&
+           min.y <= box.max.y && max.y >= box.min.y &&
+           min.z <= box.max.z && max.z >= box.min.z;
+  }
+};
+
+struct Ray {
+  glm::vec3 origin;
+  glm::vec3 direction;
+};
+
+// view frustum as six inward facing planes (ax + by + cz + d >= 0 inside),
+// ordered left, right, bottom, top, near, far
+struct Frustum {
+  glm::vec4 planes[6];
+
+  // extract the planes from a projection * view matrix (Gribb/Hartmann)
+  static Frustum fromMatrix(const glm::mat4& view_projection);
+
+  // conservative box test, may report boxes near the frustum corners as visible
+  bool intersects(const AABB& box) const;
+};
+
+inline Frustum Frustum::fromMatrix(const glm::mat4& m) {
+  // glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+  const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+  Frustum frustum;
+  frustum.planes[0] = row3 + row0;
+  frustum.planes[1] = row3 - row0;
+  frustum.planes[2] = row3 + row1;
+  frustum.planes[3] = row3 - row1;
+  frustum.planes[4] = row3 + row2;
+  frustum.planes[5] = row3 - row2;
+  for (glm::vec4& plane : frustum.planes)
+    plane /= glm::length(glm::vec3(plane));
+  return frustum;
+}
+
+inline bool Frustum::intersects(const AABB& box) const {
+  for (const glm::vec4& plane : planes) {
+    // corner of the box furthest along the plane normal
+    const glm::vec3 p(plane.x > 0.0f ? box.max.x : box.min.x,
+                      plane.y > 0.0f ? box.max.y : box.min.y,
+                      plane.z > 0.0f ? box.max.z : box.min.z);
+    if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+// bounds of a box after an affine transform (Arvo)
+inline AABB transformAABB(const glm::mat4& m, const AABB& box) {
+  const glm::vec3 center = glm::vec3(m * glm::vec4(box.center(), 1.0f));
+  const glm::vec3 half = 0.5f * box.extent();
+  const glm::mat3 abs_m(glm::abs(glm::vec3(m[0])), glm::abs(glm::vec3(m[1])), glm::abs(glm::vec3(m[2])));
+  const glm::vec3 extent = abs_m * half;
+  return AABB(center - extent, center + extent);
+}
+
+// slab test, on a hit distance receives the entry distance along the ray
+inline bool intersectRay(const Ray& ray, const AABB& box, float max_distance, float* distance = nullptr) {
+  const glm::vec3 inv_dir = 1.0f / ray.direction;
+  const glm::vec3 t0 = (box.min - ray.origin) * inv_dir;
+  const glm::vec3 t1 = (box.max - ray.origin) * inv_dir;
+  const glm::vec3 t_near = glm::min(t0, t1);
+  const glm::vec3 t_far = glm::max(t0, t1);
+  const float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+  const float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_distance));
+  if (enter > exit)
+    return false;
+  if (distance)
+    *distance = enter;
+  return true;
+}
+
+#endif
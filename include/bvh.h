@@ -0,0 +1,612 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+#include "bounds.h"
+
+// Bounding volume hierarchy over object AABBs.
+// Built top-down with binned SAH and collapsed into a flat array of 4-wide nodes
+// in depth-first order, so a child always comes after its parent: one node visit
+// tests four child boxes at once and refitting is a single reverse scan.
+class BVH {
+public:
+  static constexpr uint32_t INVALID = 0xffffffffu;
+
+  // child boxes are stored per axis so the four of them load as one SIMD register
+  struct alignas(64) Node {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    // inner child: node index, leaf child: first entry in the object list
+    uint32_t child[4];
+    // number of objects in a leaf child, 0 for inner children
+    uint32_t count[4];
+  };
+
+  ~BVH();
+
+  // (re)build over boxes, object ids are indices into boxes
+  void build(const std::vector<AABB>& boxes);
+
+  // move an object, the change reaches the hierarchy on the next refit()
+  void setBounds(uint32_t object, const AABB& box);
+  // refit only the nodes above objects moved since the last refit
+  void refit();
+  // true once refitting degraded the tree noticeably compared to a fresh build
+  bool needsRebuild() const;
+  // rebuild from a snapshot of the current boxes on a worker thread
+  void rebuildAsync();
+  // install a finished background rebuild, returns true if the tree was replaced
+  bool pollRebuild();
+  bool rebuilding() const { return rebuild_.valid(); }
+
+  // queries append the ids of the matching objects to out
+  void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+  void queryRay(const Ray& ray, float max_distance, std::vector<uint32_t>& out) const;
+  void queryOverlap(const AABB& box, std::vector<uint32_t>& out) const;
+
+  size_t objectCount() const { return boxes_.size(); }
+  size_t nodeCount() const { return tree_.nodes.size(); }
+  const AABB& bounds(uint32_t object) const { return boxes_[object]; }
+  // surface area heuristic cost of the current tree
+  float cost() const;
+
+private:
+  static constexpr int BIN_COUNT = 16;
+  static constexpr uint32_t LEAF_SIZE = 4;
+  // rebuild once the refitted tree is this much more expensive than the built one
+  static constexpr float REBUILD_THRESHOLD = 1.3f;
+
+  struct Tree {
+    std::vector<Node> nodes;
+    std::vector<uint32_t> objects;      // object ids, each leaf owns a contiguous run
+    std::vector<uint32_t> parent;       // parent of each node
+    std::vector<uint32_t> object_node;  // node whose leaf holds each object
+  };
+
+  struct BinaryNode {
+    AABB box;
+    uint32_t left, right;
+    uint32_t first, count;  // count > 0 for leaves
+  };
+
+  static Tree buildTree(const std::vector<AABB>& boxes);
+  static void buildBinary(const std::vector<AABB>& boxes, std::vector<uint32_t>& objects,
+                          std::vector<BinaryNode>& out);
+  static uint32_t collapse(const std::vector<BinaryNode>& binary, uint32_t node, uint32_t parent, Tree& tree);
+  static void setLane(Node& node, int lane, const AABB& box);
+  static AABB laneBounds(const Node& node, int lane);
+
+  static int validLanes(const Node& node);
+  static void testFrustum(const Node& node, const Frustum& frustum, int& visible, int& inside);
+  static int testRay(const Node& node, const glm::vec3& origin, const glm::vec3& inv_dir, float max_distance);
+  static int testOverlap(const Node& node, const AABB& box);
+
+  void refitNode(uint32_t node);
+  void refitAll();
+  void appendSubtree(uint32_t node, std::vector<uint32_t>& out) const;
+
+  std::vector<AABB> boxes_;
+  Tree tree_;
+  std::vector<uint8_t> dirty_;
+  std::vector<uint32_t> dirty_nodes_;
+  float build_cost_ = 0.0f;
+  std::future<Tree> rebuild_;
+};
+
+inline BVH::~BVH() {
+  if (rebuild_.valid())
+    rebuild_.wait();
+}
+
+inline void BVH::build(const std::vector<AABB>& boxes) {
+  // a tree still being built in the background belongs to the old object set
+  if (rebuild_.valid())
+    rebuild_.get();
+  boxes_ = boxes;
+  tree_ = buildTree(boxes_);
+  dirty_.assign(tree_.nodes.size(), 0);
+  dirty_nodes_.clear();
+  build_cost_ = cost();
+}
+
+inline void BVH::setBounds(uint32_t object, const AABB& box) {
+  boxes_[object] = box;
+  // ancestors of a dirty node are dirty already, stop there
+  for (uint32_t node = tree_.object_node[object]; node != INVALID && !dirty_[node]; node = tree_.parent[node]) {
+    dirty_[node] = 1;
+    dirty_nodes_.push_back(node);
+  }
+}
+
+inline void BVH::refit() {
+  // children have larger indices than their parents
+  std::sort(dirty_nodes_.begin(), dirty_nodes_.end(), std::greater<uint32_t>());
+  for (uint32_t node : dirty_nodes_) {
+    refitNode(node);
+    dirty_[node] = 0;
+  }
+  dirty_nodes_.clear();
+}
+
+inline bool BVH::needsRebuild() const {
+  return !tree_.nodes.empty() && cost() > REBUILD_THRESHOLD * build_cost_;
+}
+
+inline void BVH::rebuildAsync() {
+  if (rebuild_.valid() || boxes_.empty())
+    return;
+  rebuild_ = std::async(std::launch::async, [boxes = boxes_]() { return buildTree(boxes); });
+}
+
+inline bool BVH::pollRebuild() {
+  if (!rebuild_.valid() || rebuild_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return false;
+  Tree tree = rebuild_.get();
+  if (tree.object_node.size() != boxes_.size())
+    return false;
+  tree_ = std::move(tree);
+  dirty_.assign(tree_.nodes.size(), 0);
+  dirty_nodes_.clear();
+  // objects kept moving while the worker was busy with the snapshot
+  refitAll();
+  build_cost_ = cost();
+  return true;
+}
+
+inline float BVH::cost() const {
+  if (tree_.nodes.empty())
+    return 0.0f;
+  AABB root;
+  for (int lane = 0; lane < 4; lane++)
+    if (tree_.nodes[0].child[lane] != INVALID)
+      root.expand(laneBounds(tree_.nodes[0], lane));
+  const float root_area = std::max(root.surfaceArea(), FLT_MIN);
+
+  // inner children cost one traversal step, leaves one test per object
+  float cost = 0.0f;
+  for (const Node& node : tree_.nodes)
+    for (int lane = 0; lane < 4; lane++)
+      if (node.child[lane] != INVALID)
+        cost += laneBounds(node, lane).surfaceArea() * std::max(node.count[lane], 1u);
+  return cost / root_area;
+}
+
+inline void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const {
+  if (tree_.nodes.empty())
+    return;
+  std::vector<uint32_t> stack(1, 0);
+  while (!stack.empty()) {
+    const Node& node = tree_.nodes[stack.back()];
+    stack.pop_back();
+
+    int visible, inside;
+    testFrustum(node, frustum, visible, inside);
+    for (int lane = 0; lane < 4; lane++) {
+      if (!(visible & (1 << lane)))
+        continue;
+      const uint32_t child = node.child[lane];
+      const uint32_t count = node.count[lane];
+      if (inside & (1 << lane)) {
+        // whole subtree inside, no more tests needed below it
+        if (count)
+          out.insert(out.end(), tree_.objects.begin() + child, tree_.objects.begin() + child + count);
+        else
+          appendSubtree(child, out);
+      }
+      else if (count) {
+        for (uint32_t i = child; i < child + count; i++)
+          if (frustum.intersects(boxes_[tree_.objects[i]]))
+            out.push_back(tree_.objects[i]);
+      }
+      else {
+        stack.push_back(child);
+      }
+    }
+  }
+}
+
+inline void BVH::queryRay(const Ray& ray, float max_distance, std::vector<uint32_t>& out) const {
+  if (tree_.nodes.empty())
+    return;
+  const glm::vec3 inv_dir = 1.0f / ray.direction;
+  std::vector<uint32_t> stack(1, 0);
+  while (!stack.empty()) {
+    const Node& node = tree_.nodes[stack.back()];
+    stack.pop_back();
+
+    const int hit = testRay(node, ray.origin, inv_dir, max_distance);
+    for (int lane = 0; lane < 4; lane++) {
+      if (!(hit & (1 << lane)))
+        continue;
+      const uint32_t child = node.child[lane];
+      const uint32_t count = node.count[lane];
+      if (count) {
+        for (uint32_t i = child; i < child + count; i++)
+          if (intersectRay(ray, boxes_[tree_.objects[i]], max_distance))
+            out.push_back(tree_.objects[i]);
+      }
+      else {
+        stack.push_back(child);
+      }
+    }
+  }
+}
+
+inline void BVH::queryOverlap(const AABB& box, std::vector<uint32_t>& out) const {
+  if (tree_.nodes.empty())
+    return;
+  std::vector<uint32_t> stack(1, 0);
+  while (!stack.empty()) {
+    const Node& node = tree_.nodes[stack.back()];
+    stack.pop_back();
+
+    const int overlap = testOverlap(node, box);
+    for (int lane = 0; lane < 4; lane++) {
+      if (!(overlap & (1 << lane)))
+        continue;
+      const uint32_t child = node.child[lane];
+      const uint32_t count = node.count[lane];
+      if (count) {
+        for (uint32_t i = child; i < child + count; i++)
+          if (box.overlaps(boxes_[tree_.objects[i]]))
+            out.push_back(tree_.objects[i]);
+      }
+      else {
+        stack.push_back(child);
+      }
+    }
+  }
+}
+
+inline BVH::Tree BVH::buildTree(const std::vector<AABB>& boxes) {
+  Tree tree;
+  if (boxes.empty())
+    return tree;
+
+  std::vector<uint32_t> objects(boxes.size());
+  for (uint32_t i = 0; i < objects.size(); i++)
+    objects[i] = i;
+  std::vector<BinaryNode> binary;
+  buildBinary(boxes, objects, binary);
+
+  tree.objects = std::move(objects);
+  tree.object_node.assign(boxes.size(), INVALID);
+  tree.nodes.reserve(binary.size() / 2 + 1);
+  tree.parent.reserve(binary.size() / 2 + 1);
+  collapse(binary, 0, INVALID, tree);
+  return tree;
+}
+
+inline void BVH::buildBinary(const std::vector<AABB>& boxes, std::vector<uint32_t>& objects,
+                             std::vector<BinaryNode>& out) {
+  struct Task { uint32_t node, begin, end; };
+  struct Bin { AABB box; uint32_t count = 0; };
+
+  std::vector<glm::vec3> centroids(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++)
+    centroids[i] = boxes[i].center();
+
+  out.push_back(BinaryNode());
+  std::vector<Task> tasks(1, Task{0, 0, (uint32_t)objects.size()});
+  while (!tasks.empty()) {
+    const Task task = tasks.back();
+    tasks.pop_back();
+
+    AABB box, centroid_box;
+    for (uint32_t i = task.begin; i < task.end; i++) {
+      box.expand(boxes[objects[i]]);
+      centroid_box.expand(centroids[objects[i]]);
+    }
+    out[task.node].box = box;
+    const uint32_t count = task.end - task.begin;
+    if (count <= LEAF_SIZE) {
+      out[task.node].first = task.begin;
+      out[task.node].count = count;
+      continue;
+    }
+
+    // bin the centroids along each axis and sweep for the cheapest split plane
+    int best_axis = -1, best_bin = 0;
+    float best_cost = FLT_MAX;
+    const glm::vec3 centroid_extent = centroid_box.extent();
+    for (int axis = 0; axis < 3; axis++) {
+      if (centroid_extent[axis] <= 0.0f)
+        continue;
+      const float scale = BIN_COUNT / centroid_extent[axis];
+      Bin bins[BIN_COUNT];
+      for (uint32_t i = task.begin; i < task.end; i++) {
+        const uint32_t object = objects[i];
+        const int b = std::min(BIN_COUNT - 1, (int)((centroids[object][axis] - centroid_box.min[axis]) * scale));
+        bins[b].box.expand(boxes[object]);
+        bins[b].count++;
+      }
+
+      float right_area[BIN_COUNT];
+      uint32_t right_count[BIN_COUNT];
+      AABB right;
+      uint32_t n = 0;
+      for (int b = BIN_COUNT - 1; b > 0; b--) {
+        right.expand(bins[b].box);
+        n += bins[b].count;
+        right_area[b] = right.surfaceArea();
+        right_count[b] = n;
+      }
+      AABB left;
+      n = 0;
+      for (int b = 0; b < BIN_COUNT - 1; b++) {
+        left.expand(bins[b].box);
+        n += bins[b].count;
+        if (n == 0 || right_count[b + 1] == 0)
+          continue;
+        const float cost = left.surfaceArea() * n + right_area[b + 1] * right_count[b + 1];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+
+    uint32_t middle;
+    if (best_axis >= 0) {
+      const float scale = BIN_COUNT / centroid_extent[best_axis];
+      const float origin = centroid_box.min[best_axis];
+      middle = (uint32_t)(std::partition(objects.begin() + task.begin, objects.begin() + task.end,
+                                         [&](uint32_t object) {
+        const int b = std::min(BIN_COUNT - 1, (int)((centroids[object][best_axis] - origin) * scale));
+        return b <= best_bin;
+      }) - objects.begin());
+    }
+    else {
+      // all centroids coincide, split by count
+      middle = task.begin + count / 2;
+    }
+
+    const uint32_t left = (uint32_t)out.size();
+    out.push_back(BinaryNode());
+    out.push_back(BinaryNode());
+    out[task.node].left = left;
+    out[task.node].right = left + 1;
+    out[task.node].count = 0;
+    tasks.push_back(Task{left, task.begin, middle});
+    tasks.push_back(Task{left + 1, middle, task.end});
+  }
+}
+
+inline uint32_t BVH::collapse(const std::vector<BinaryNode>& binary, uint32_t node, uint32_t parent, Tree& tree) {
+  // pull grandchildren up until the node is four wide, opening the largest child first;
+  // children stay in object order so every subtree keeps a contiguous object run
+  uint32_t lanes[4];
+  int lane_count = 0;
+  if (binary[node].count) {
+    lanes[lane_count++] = node;
+  }
+  else {
+    lanes[lane_count++] = binary[node].left;
+    lanes[lane_count++] = binary[node].right;
+  }
+  while (lane_count < 4) {
+    int open = -1;
+    float open_area = -1.0f;
+    for (int i = 0; i < lane_count; i++) {
+      const BinaryNode& child = binary[lanes[i]];
+      if (child.count == 0 && child.box.surfaceArea() > open_area) {
+        open = i;
+        open_area = child.box.surfaceArea();
+      }
+    }
+    if (open < 0)
+      break;
+    const BinaryNode& opened = binary[lanes[open]];
+    for (int i = lane_count; i > open + 1; i--)
+      lanes[i] = lanes[i - 1];
+    lanes[open] = opened.left;
+    lanes[open + 1] = opened.right;
+    lane_count++;
+  }
+
+  const uint32_t index = (uint32_t)tree.nodes.size();
+  tree.nodes.push_back(Node());
+  tree.parent.push_back(parent);
+  for (int lane = 0; lane < 4; lane++) {
+    if (lane >= lane_count) {
+      setLane(tree.nodes[index], lane, AABB());
+      tree.nodes[index].child[lane] = INVALID;
+      tree.nodes[index].count[lane] = 0;
+      continue;
+    }
+    const BinaryNode& child = binary[lanes[lane]];
+    setLane(tree.nodes[index], lane, child.box);
+    if (child.count) {
+      tree.nodes[index].child[lane] = child.first;
+      tree.nodes[index].count[lane] = child.count;
+      for (uint32_t i = child.first; i < child.first + child.count; i++)
+        tree.object_node[tree.objects[i]] = index;
+    }
+    else {
+      // recursing grows tree.nodes, write through the index afterwards
+      const uint32_t grandchild = collapse(binary, lanes[lane], index, tree);
+      tree.nodes[index].child[lane] = grandchild;
+      tree.nodes[index].count[lane] = 0;
+    }
+  }
+  return index;
+}
+
+inline void BVH::setLane(Node& node, int lane, const AABB& box) {
+  node.min_x[lane] = box.min.x;
+  node.min_y[lane] = box.min.y;
+  node.min_z[lane] = box.min.z;
+  node.max_x[lane] = box.max.x;
+  node.max_y[lane] = box.max.y;
+  node.max_z[lane] = box.max.z;
+}
+
+inline AABB BVH::laneBounds(const Node& node, int lane) {
+  return AABB(glm::vec3(node.min_x[lane], node.min_y[lane], node.min_z[lane]),
+              glm::vec3(node.max_x[lane], node.max_y[lane], node.max_z[lane]));
+}
+
+inline void BVH::refitNode(uint32_t index) {
+  Node& node = tree_.nodes[index];
+  for (int lane = 0; lane < 4; lane++) {
+    if (node.child[lane] == INVALID)
+      continue;
+    AABB box;
+    if (node.count[lane]) {
+      for (uint32_t i = node.child[lane]; i < node.child[lane] + node.count[lane]; i++)
+        box.expand(boxes_[tree_.objects[i]]);
+    }
+    else {
+      const Node& child = tree_.nodes[node.child[lane]];
+      for (int child_lane = 0; child_lane < 4; child_lane++)
+        if (child.child[child_lane] != INVALID)
+          box.expand(laneBounds(child, child_lane));
+    }
+    setLane(node, lane, box);
+  }
+}
+
+inline void BVH::refitAll() {
+  for (size_t i = tree_.nodes.size(); i-- > 0;)
+    refitNode((uint32_t)i);
+}
+
+inline void BVH::appendSubtree(uint32_t index, std::vector<uint32_t>& out) const {
+  // a subtree owns a contiguous run of the object list, walk down its outermost lanes for the ends
+  uint32_t node = index;
+  while (tree_.nodes[node].count[0] == 0)
+    node = tree_.nodes[node].child[0];
+  const uint32_t begin = tree_.nodes[node].child[0];
+
+  node = index;
+  for (;;) {
+    int lane = 3;
+    while (tree_.nodes[node].child[lane] == INVALID)
+      lane--;
+    if (tree_.nodes[node].count[lane]) {
+      const uint32_t end = tree_.nodes[node].child[lane] + tree_.nodes[node].count[lane];
+      out.insert(out.end(), tree_.objects.begin() + begin, tree_.objects.begin() + end);
+      return;
+    }
+    node = tree_.nodes[node].child[lane];
+  }
+}
+
+inline int BVH::validLanes(const Node& node) {
+  return (node.child[0] != INVALID ? 1 : 0) | (node.child[1] != INVALID ? 2 : 0) |
+         (node.child[2] != INVALID ? 4 : 0) | (node.child[3] != INVALID ? 8 : 0);
+}
+
+#if defined(__SSE2__)
+
+inline void BVH::testFrustum(const Node& node, const Frustum& frustum, int& visible, int& inside) {
+  const __m128 zero = _mm_setzero_ps();
+  __m128 outside_mask = _mm_setzero_ps();
+  __m128 inside_mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  for (const glm::vec4& plane : frustum.planes) {
+    // the corner furthest along the normal decides if a box is outside,
+    // the nearest one if it is completely inside
+    const __m128 far_x = _mm_load_ps(plane.x > 0.0f ? node.max_x : node.min_x);
+    const __m128 far_y = _mm_load_ps(plane.y > 0.0f ? node.max_y : node.min_y);
+    const __m128 far_z = _mm_load_ps(plane.z > 0.0f ? node.max_z : node.min_z);
+    const __m128 near_x = _mm_load_ps(plane.x > 0.0f ? node.min_x : node.max_x);
+    const __m128 near_y = _mm_load_ps(plane.y > 0.0f ? node.min_y : node.max_y);
+    const __m128 near_z = _mm_load_ps(plane.z > 0.0f ? node.min_z : node.max_z);
+    const __m128 a = _mm_set1_ps(plane.x);
+    const __m128 b = _mm_set1_ps(plane.y);
+    const __m128 c = _mm_set1_ps(plane.z);
+    const __m128 d = _mm_set1_ps(plane.w);
+    const __m128 far_dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(far_x, a), _mm_mul_ps(far_y, b)),
+                                       _mm_add_ps(_mm_mul_ps(far_z, c), d));
+    const __m128 near_dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(near_x, a), _mm_mul_ps(near_y, b)),
+                                        _mm_add_ps(_mm_mul_ps(near_z, c), d));
+    outside_mask = _mm_or_ps(outside_mask, _mm_cmplt_ps(far_dist, zero));
+    inside_mask = _mm_and_ps(inside_mask, _mm_cmpge_ps(near_dist, zero));
+  }
+  visible = ~_mm_movemask_ps(outside_mask) & validLanes(node);
+  inside = _mm_movemask_ps(inside_mask) & visible;
+}
+
+inline int BVH::testRay(const Node& node, const glm::vec3& origin, const glm::vec3& inv_dir, float max_distance) {
+  const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+  const __m128 ix = _mm_set1_ps(inv_dir.x), iy = _mm_set1_ps(inv_dir.y), iz = _mm_set1_ps(inv_dir.z);
+  const __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x), ox), ix);
+  const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x), ox), ix);
+  const __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y), oy), iy);
+  const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y), oy), iy);
+  const __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z), oz), iz);
+  const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z), oz), iz);
+  const __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+                                  _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+  const __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+                                 _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(max_distance)));
+  return _mm_movemask_ps(_mm_cmple_ps(enter, exit)) & validLanes(node);
+}
+
+inline int BVH::testOverlap(const Node& node, const AABB& box) {
+  __m128 mask = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.min_x), _mm_set1_ps(box.max.x)),
+                           _mm_cmpge_ps(_mm_load_ps(node.max_x), _mm_set1_ps(box.min.x)));
+  mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.min_y), _mm_set1_ps(box.max.y)),
+                                     _mm_cmpge_ps(_mm_load_ps(node.max_y), _mm_set1_ps(box.min.y))));
+  mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.min_z), _mm_set1_ps(box.max.z)),
+                                     _mm_cmpge_ps(_mm_load_ps(node.max_z), _mm_set1_ps(box.min.z))));
+  return _mm_movemask_ps(mask) & validLanes(node);
+}
+
+#else
+
+inline void BVH::testFrustum(const Node& node, const Frustum& frustum, int& visible, int& inside) {
+  visible = inside = 0;
+  for (int lane = 0; lane < 4; lane++) {
+    if (node.child[lane] == INVALID)
+      continue;
+    const AABB box = laneBounds(node, lane);
+    bool lane_visible = true, lane_inside = true;
+    for (const glm::vec4& plane : frustum.planes) {
+      const glm::vec3 far_corner(plane.x > 0.0f ? box.max.x : box.min.x,
+                                 plane.y > 0.0f ? box.max.y : box.min.y,
+                                 plane.z > 0.0f ? box.max.z : box.min.z);
+      const glm::vec3 near_corner(plane.x > 0.0f ? box.min.x : box.max.x,
+                                  plane.y > 0.0f ? box.min.y : box.max.y,
+                                  plane.z > 0.0f ? box.min.z : box.max.z);
+      lane_visible &= glm::dot(glm::vec3(plane), far_corner) + plane.w >= 0.0f;
+      lane_inside &= glm::dot(glm::vec3(plane), near_corner) + plane.w >= 0.0f;
+    }
+    visible |= lane_visible ? 1 << lane : 0;
+    inside |= lane_visible && lane_inside ? 1 << lane : 0;
+  }
+}
+
+inline int BVH::testRay(const Node& node, const glm::vec3& origin, const glm::vec3& inv_dir, float max_distance) {
+  const Ray ray{origin, 1.0f / inv_dir};
+  int hit = 0;
+  for (int lane = 0; lane < 4; lane++)
+    if (node.child[lane] != INVALID && intersectRay(ray, laneBounds(node, lane), max_distance))
+      hit |= 1 << lane;
+  return hit;
+}
+
+inline int BVH::testOverlap(const Node& node, const AABB& box) {
+  int overlap = 0;
+  for (int lane = 0; lane < 4; lane++)
+    if (node.child[lane] != INVALID && box.overlaps(laneBounds(node, lane)))
+      overlap |= 1 << lane;
+  return overlap;
+}
+
+#endif
+
+#endif
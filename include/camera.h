@@ -0,0 +1,148 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+#include "bounds.h"
+
+// Perspective camera that caches its matrices and frustum, recomputing them only
+// after a parameter actually changed. version() counts those changes, so uniform
+// uploads and culling can be skipped while it stays the same.
+//
+// With reverse Z the near plane maps to depth 1 and the far plane (or infinity) to 0.
+// That only gains precision with glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE), and
+// needs glDepthFunc(GL_GREATER) and the depth buffer cleared to 0.
+class Camera {
+public:
+  Camera() = default;
+
+  // far_plane may be INFINITY
+  void setPerspective(float fovy, float near_plane, float far_plane);
+  void setAspect(float aspect);
+  // aspect from the framebuffer size, ignores minimized windows
+  void setViewport(int width, int height);
+  void setReverseZ(bool reverse_z);
+
+  void setView(const glm::mat4& view);
+  void lookAt(const glm::vec3& eye, const glm::vec3& target, const glm::vec3& up = glm::vec3(0.0f, 1.0f, 0.0f)) {
+    setView(glm::lookAt(eye, target, up));
+  }
+
+  float fovy() const { return fovy_; }
+  float aspect() const { return aspect_; }
+  float nearPlane() const { return near_; }
+  float farPlane() const { return far_; }
+  bool infinite() const { return std::isinf(far_); }
+  bool reverseZ() const { return reverse_z_; }
+  glm::vec3 position() const { return glm::vec3(inverseView()[3]); }
+
+  const glm::mat4& view() const { return view_; }
+  const glm::mat4& projection() const { update(); return projection_; }
+  const glm::mat4& viewProjection() const { update(); return view_projection_; }
+  const glm::mat4& inverseView() const { update(); return inverse_view_; }
+  const glm::mat4& inverseProjection() const { update(); return inverse_projection_; }
+  const glm::mat4& inverseViewProjection() const { update(); return inverse_view_projection_; }
+  const Frustum& frustum() const { update(); return frustum_; }
+
+  uint64_t version() const { return version_; }
+
+private:
+  void update() const;
+  glm::mat4 buildProjection(bool reverse_z) const;
+
+  float fovy_ = glm::radians(45.0f);
+  float aspect_ = 800.0f / 600.0f;
+  float near_ = 0.1f;
+  float far_ = 100.0f;
+  bool reverse_z_ = false;
+  glm::mat4 view_ = glm::mat4(1.0f);
+  uint64_t version_ = 1;
+
+  mutable bool view_dirty_ = true;
+  mutable bool projection_dirty_ = true;
+  mutable glm::mat4 projection_;
+  mutable glm::mat4 culling_projection_;   // the same volume in OpenGL's default depth range
+  mutable glm::mat4 view_projection_;
+  mutable glm::mat4 inverse_view_;
+  mutable glm::mat4 inverse_projection_;
+  mutable glm::mat4 inverse_view_projection_;
+  mutable Frustum frustum_;
+};
+
+inline void Camera::setPerspective(float fovy, float near_plane, float far_plane) {
+  if (fovy == fovy_ && near_plane == near_ && far_plane == far_)
+    return;
+  fovy_ = fovy;
+  near_ = near_plane;
+  far_ = far_plane;
+  projection_dirty_ = true;
+  version_++;
+}
+
+inline void Camera::setAspect(float aspect) {
+  if (aspect == aspect_)
+    return;
+  aspect_ = aspect;
+  projection_dirty_ = true;
+  version_++;
+}
+
+inline void Camera::setViewport(int width, int height) {
+  if (width > 0 && height > 0)
+    setAspect((float)width / (float)height);
+}
+
+inline void Camera::setReverseZ(bool reverse_z) {
+  if (reverse_z == reverse_z_)
+    return;
+  reverse_z_ = reverse_z;
+  projection_dirty_ = true;
+  version_++;
+}
+
+inline void Camera::setView(const glm::mat4& view) {
+  if (view == view_)
+    return;
+  view_ = view;
+  view_dirty_ = true;
+  version_++;
+}
+
+inline glm::mat4 Camera::buildProjection(bool reverse_z) const {
+  if (!reverse_z)
+    return infinite() ? glm::infinitePerspective(fovy_, aspect_, near_) : glm::perspective(fovy_, aspect_, near_, far_);
+  if (!infinite())
+    return glm::perspectiveRH_ZO(fovy_, aspect_, far_, near_);  // swapped planes flip the depth range
+  // clip z is the constant near distance, so depth = near / distance
+  const float f = 1.0f / std::tan(0.5f * fovy_);
+  glm::mat4 projection(0.0f);
+  projection[0][0] = f / aspect_;
+  projection[1][1] = f;
+  projection[2][3] = -1.0f;
+  projection[3][2] = near_;
+  return projection;
+}
+
+inline void Camera::update() const {
+  if (!view_dirty_ && !projection_dirty_)
+    return;
+  if (projection_dirty_) {
+    projection_ = buildProjection(reverse_z_);
+    culling_projection_ = reverse_z_ ? buildProjection(false) : projection_;
+    inverse_projection_ = glm::inverse(projection_);
+  }
+  if (view_dirty_)
+    inverse_view_ = glm::inverse(view_);
+  view_projection_ = projection_ * view_;
+  inverse_view_projection_ = inverse_view_ * inverse_projection_;
+  frustum_ = Frustum::fromMatrix(culling_projection_ * view_);
+  if (infinite())
+    frustum_.planes[5] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);  // the far plane at infinity keeps everything
+  view_dirty_ = projection_dirty_ = false;
+}
+
+#endif
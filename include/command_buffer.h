@@ -0,0 +1,174 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gl_state.h"
+
+// GL calls recorded as plain structs packed one after the other in a byte arena, to
+// be replayed later on the thread that owns the context. Recording touches no GL at
+// all, so every worker can fill its own buffer in parallel; replaying is a tight loop
+// over the arena that binds through the state cache. clear() keeps the arena's
+// memory, a buffer reused every frame stops allocating after the first few.
+class CommandBuffer {
+public:
+  void clear() {
+    arena_.clear();
+    count_ = 0;
+  }
+
+  void useProgram(GLuint program) { record(UseProgram{Op::UseProgram, program}); }
+  void bindVertexArray(GLuint vao) { record(BindVertexArray{Op::BindVertexArray, vao}); }
+  void bindBuffer(GLenum target, GLuint buffer) { record(BindBuffer{Op::BindBuffer, target, buffer}); }
+  void bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    record(BindTexture{Op::BindTexture, unit, target, texture});
+  }
+  void enable(GLenum capability) { record(Capability{Op::Enable, capability}); }
+  void disable(GLenum capability) { record(Capability{Op::Disable, capability}); }
+  void depthMask(bool write) { record(DepthMask{Op::DepthMask, write ? 1u : 0u}); }
+
+  // the values are copied, the caller's memory may be gone by the time the buffer runs
+  void uniform4(GLint location, const float* value);
+  void uniformMatrix4(GLint location, const float* value);
+
+  void drawElements(GLenum mode, GLsizei count, GLenum type, size_t offset) {
+    record(DrawElements{Op::DrawElements, mode, count, type, 1, (uint64_t)offset});
+  }
+  void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instance_count) {
+    record(DrawElements{Op::DrawElements, mode, count, type, instance_count, (uint64_t)offset});
+  }
+
+  size_t commandCount() const { return count_; }
+  size_t bytes() const { return arena_.size(); }
+
+  // issue the commands in the order they were recorded, on the GL thread
+  void execute(GLState& state) const;
+
+private:
+  enum class Op : uint32_t {
+    UseProgram, BindVertexArray, BindBuffer, BindTexture, Enable, Disable, DepthMask,
+    Uniform4, UniformMatrix4, DrawElements
+  };
+
+  // every command starts with its op
+  struct UseProgram { Op op; GLuint program; };
+  struct BindVertexArray { Op op; GLuint vao; };
+  struct BindBuffer { Op op; GLenum target; GLuint buffer; };
+  struct BindTexture { Op op; GLuint unit; GLenum target; GLuint texture; };
+  struct Capability { Op op; GLenum capability; };
+  struct DepthMask { Op op; GLuint write; };
+  struct Uniform4 { Op op; GLint location; float value[4]; };
+  struct UniformMatrix4 { Op op; GLint location; float value[16]; };
+  struct DrawElements { Op op; GLenum mode; GLsizei count; GLenum type; GLsizei instance_count; uint64_t offset; };
+
+  // copied in and out byte for byte, so the arena needs no alignment
+  template <typename Command>
+  void record(const Command& command) {
+    const size_t offset = arena_.size();
+    arena_.resize(offset + sizeof(Command));
+    std::memcpy(arena_.data() + offset, &command, sizeof(Command));
+    count_++;
+  }
+
+  template <typename Command>
+  static Command read(const uint8_t* data) {
+    Command command;
+    std::memcpy(&command, data, sizeof(Command));
+    return command;
+  }
+
+  std::vector<uint8_t> arena_;
+  size_t count_ = 0;
+};
+
+inline void CommandBuffer::uniform4(GLint location, const float* value) {
+  Uniform4 command{Op::Uniform4, location, {}};
+  std::memcpy(command.value, value, sizeof(command.value));
+  record(command);
+}
+
+inline void CommandBuffer::uniformMatrix4(GLint location, const float* value) {
+  UniformMatrix4 command{Op::UniformMatrix4, location, {}};
+  std::memcpy(command.value, value, sizeof(command.value));
+  record(command);
+}
+
+inline void CommandBuffer::execute(GLState& state) const {
+  const uint8_t* data = arena_.data();
+  const uint8_t* const end = data + arena_.size();
+  while (data < end) {
+    switch (read<Op>(data)) {
+      case Op::UseProgram: {
+        const auto command = read<UseProgram>(data);
+        state.useProgram(command.program);
+        data += sizeof(command);
+        break;
+      }
+      case Op::BindVertexArray: {
+        const auto command = read<BindVertexArray>(data);
+        state.bindVertexArray(command.vao);
+        data += sizeof(command);
+        break;
+      }
+      case Op::BindBuffer: {
+        const auto command = read<BindBuffer>(data);
+        state.bindBuffer(command.target, command.buffer);
+        data += sizeof(command);
+        break;
+      }
+      case Op::BindTexture: {
+        const auto command = read<BindTexture>(data);
+        state.bindTexture(command.unit, command.target, command.texture);
+        data += sizeof(command);
+        break;
+      }
+      case Op::Enable: {
+        const auto command = read<Capability>(data);
+        state.enable(command.capability);
+        data += sizeof(command);
+        break;
+      }
+      case Op::Disable: {
+        const auto command = read<Capability>(data);
+        state.disable(command.capability);
+        data += sizeof(command);
+        break;
+      }
+      case Op::DepthMask: {
+        const auto command = read<DepthMask>(data);
+        state.depthMask(command.write != 0);
+        data += sizeof(command);
+        break;
+      }
+      case Op::Uniform4: {
+        const auto command = read<Uniform4>(data);
+        glUniform4fv(command.location, 1, command.value);
+        data += sizeof(command);
+        break;
+      }
+      case Op::UniformMatrix4: {
+        const auto command = read<UniformMatrix4>(data);
+        glUniformMatrix4fv(command.location, 1, GL_FALSE, command.value);
+        data += sizeof(command);
+        break;
+      }
+      case Op::DrawElements: {
+        const auto command = read<DrawElements>(data);
+        if (command.instance_count == 1)
+          glDrawElements(command.mode, command.count, command.type, (void*)command.offset);
+        else
+          glDrawElementsInstanced(command.mode, command.count, command.type, (void*)command.offset,
+                                  command.instance_count);
+        data += sizeof(command);
+        break;
+      }
+    }
+  }
+}
+
+#endif
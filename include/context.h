@@ -0,0 +1,518 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "frame_pacer.h"
+#include "trace.h"
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// how the samples get their OpenGL 4 core context, from the command line:
+//   --headless   no window, render offscreen (EGL on Mesa's surfaceless platform)
+//   --frames N   close after N frames, with or without a window
+//   --stats FILE write the frame statistics as JSON, see ContextStats
+//   --trace FILE write the CPU trace zones as Chrome trace JSON when the context closes
+//   --startup FILE       print where the time to the first frame went and write it as JSON, see ContextStartup
+//   --capture FILE       save the last frame as PNG, needs --frames, see ContextCapture
+//   --capture-every N    save every Nth frame instead, FILE gets the frame number before its extension
+//   --fixed-step         time() advances 1/60 s per frame, so frame N looks the same on every run
+//   --pacing MODE        vsync, adaptive, cap or unlocked, see FramePacer; F1 switches at runtime
+//   --fps N              the frame rate cap, implies --pacing cap
+//   --on-demand          only draw a frame when something changed, see Context::invalidate()
+//   --continuous         draw frames back to back, the default unless the sample says otherwise
+//   --gl-debug           a debug context with its messages collected by GLDebug, see ContextDebug
+struct ContextOptions {
+  bool headless = false;
+  int frames = 0;          // 0 runs until the window is closed, headless runs need a count
+  std::string stats;
+  std::string trace;
+  std::string startup;
+  std::string capture;
+  int capture_every = 0;
+  bool fixed_step = false;
+  std::string pacing;      // empty for vsync with a window, unlocked headless
+  double fps = 0.0;
+  // for samples whose image only changes with input, which set it before parsing: the
+  // window sits idle between frames. Animated samples keep drawing by calling
+  // Context::invalidate() every frame
+  bool on_demand = false;
+  bool gl_debug = false;
+  int minor_version = 2;   // up to the sample, not the command line
+};
+
+// as close to the process start as a header gets, startup is measured from here
+inline const std::chrono::steady_clock::time_point PROCESS_START = std::chrono::steady_clock::now();
+
+// options is what the sample picked, the command line overrides it
+inline ContextOptions parseContextOptions(int argc, char** argv, ContextOptions options = ContextOptions()) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--headless") == 0)
+      options.headless = true;
+    else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      options.frames = std::atoi(argv[++i]);
+    else if (std::strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+      options.stats = argv[++i];
+    else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      options.trace = argv[++i];
+    else if (std::strcmp(argv[i], "--startup") == 0 && i + 1 < argc)
+      options.startup = argv[++i];
+    else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+      options.capture = argv[++i];
+    else if (std::strcmp(argv[i], "--capture-every") == 0 && i + 1 < argc)
+      options.capture_every = std::atoi(argv[++i]);
+    else if (std::strcmp(argv[i], "--fixed-step") == 0)
+      options.fixed_step = true;
+    else if (std::strcmp(argv[i], "--pacing") == 0 && i + 1 < argc)
+      options.pacing = argv[++i];
+    else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+      options.fps = std::atof(argv[++i]);
+    else if (std::strcmp(argv[i], "--on-demand") == 0)
+      options.on_demand = true;
+    else if (std::strcmp(argv[i], "--continuous") == 0)
+      options.on_demand = false;
+    else if (std::strcmp(argv[i], "--gl-debug") == 0)
+      options.gl_debug = true;
+  }
+  if (options.headless && options.frames <= 0)
+    options.frames = 100;
+  return options;
+}
+
+// Hooks onto a context's loop, registered with Context::addObserver(). What the
+// samples opt into on top of the loop registers itself in its constructor and goes
+// before the context does; ContextTools holds all of them.
+class ContextObserver {
+public:
+  virtual ~ContextObserver() = default;
+
+  // the frame's commands are all issued, right before the frame is paced and swapped
+  virtual void beforeSwap() {}
+  // right after the swap, frame() is still the frame swapped
+  virtual void afterSwap() {}
+  // a key of the window, before the sample's callback gets it
+  virtual void key(int key, int action) {}
+};
+
+// A GLFW window with its context, or with --headless an EGL context without any
+// surface rendering into a framebuffer object of the same size, bound in place of
+// the default framebuffer. Either way GLEW is loaded once the constructor returns,
+// and the samples run the same code: only input and window events differ, headless
+// has none. Rebinding the window's framebuffer has to go through framebuffer().
+// Its observers are called in the order they were added.
+//
+// The trace gets a "frame" zone from swap to swap and one for the swap itself.
+//
+// The steps of creating the context are trace zones recorded with or without
+// TRACING, as is the first swap, for ContextStartup to sum up.
+//
+// Every swap goes through the FramePacer. The context installs the window's input
+// callbacks itself, forwarding keys to the sample's callback, so any input counts
+// towards the pacer's latency; F1 switches the pacing mode and reports the last one.
+//
+// With --gl-debug the context is created as a debug context, for ContextDebug to
+// collect its messages.
+//
+// On demand, pollEvents() sleeps in glfwWaitEvents() until the next frame is needed:
+// after input, a resize or the window being exposed, or once the sample called
+// invalidate(), which any thread may, a file watcher for instance. A sample that
+// animates calls invalidate() every frame it draws, or invalidate(seconds) to wake
+// up for its next step. Headless there are no events to wait for and every frame
+// is drawn.
+class Context {
+public:
+  Context(int width, int height, const char* title, const ContextOptions& options = ContextOptions());
+  ~Context();
+
+  Context(const Context&) = delete;
+  Context& operator=(const Context&) = delete;
+
+  // false if the window or context could not be created, the reason went to cout
+  bool valid() const { return valid_; }
+  bool headless() const { return options_.headless; }
+  // nullptr when headless
+  GLFWwindow* window() const { return window_; }
+  // the framebuffer the window shows, 0 with a window, the offscreen one headless
+  GLuint framebuffer() const { return framebuffer_; }
+  void framebufferSize(int* width, int* height) const;
+
+  // the callbacks never run headless
+  void setFramebufferSizeCallback(GLFWframebuffersizefun callback) { framebuffer_size_callback_ = callback; }
+  void setKeyCallback(GLFWkeyfun callback) { key_callback_ = callback; }
+  bool keyPressed(int key) const { return window_ && glfwGetKey(window_, key) == GLFW_PRESS; }
+
+  bool shouldClose() const;
+  void setShouldClose();
+  void swapBuffers();
+  // on demand, waits for the next frame to be needed
+  void pollEvents();
+
+  // the next frame needs drawing, on demand; the first from any thread, the second from the sample's
+  void invalidate();
+  void invalidate(double seconds);
+
+  // seconds since the context was created, or frames / 60 with --fixed-step; any
+  // thread may ask, a simulation running ahead of the swaps for instance
+  double time() const;
+  // frames swapped so far
+  int frame() const { return frame_; }
+
+  // draw calls the sample made, for the statistics
+  void countDraws(size_t count = 1) { draws_ += count; }
+  size_t draws() const { return draws_; }
+
+  const ContextOptions& options() const { return options_; }
+  FramePacer& pacer() { return *pacer_; }
+
+  void addObserver(ContextObserver* observer) { observers_.push_back(observer); }
+  void removeObserver(ContextObserver* observer);
+
+private:
+  bool createWindow(int width, int height, const char* title);
+  bool createHeadless();
+  bool loadFunctions();
+  FramePacer::Mode pacingMode() const;
+  void reportPacing();
+  static Context& of(GLFWwindow* window) { return *(Context*)glfwGetWindowUserPointer(window); }
+  static void framebufferSizeCallback(GLFWwindow* window, int width, int height);
+  static void refreshCallback(GLFWwindow* window);
+  static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+  static void cursorPosCallback(GLFWwindow* window, double x, double y);
+  static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+  static void scrollCallback(GLFWwindow* window, double x, double y);
+
+  ContextOptions options_;
+  bool valid_ = false;
+  bool close_ = false;
+  std::atomic<int> frame_{0};   // time() reads it, from any thread
+  int width_ = 0, height_ = 0;
+  GLFWwindow* window_ = nullptr;
+  GLuint framebuffer_ = 0;
+  GLuint renderbuffers_[2] = {0, 0};
+  GLFWframebuffersizefun framebuffer_size_callback_ = nullptr;
+  GLFWkeyfun key_callback_ = nullptr;
+  std::atomic<bool> invalid_{true};
+  std::atomic<bool> waiting_{false};   // pollEvents() is in glfwWaitEvents(), on demand
+  std::chrono::steady_clock::time_point redraw_at_ = std::chrono::steady_clock::time_point::max();
+  std::unique_ptr<FramePacer> pacer_;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t frame_begin_ = Trace::now();
+  size_t draws_ = 0;
+  std::vector<ContextObserver*> observers_;
+#ifdef HAVE_EGL
+  EGLDisplay display_ = EGL_NO_DISPLAY;
+  EGLContext egl_context_ = EGL_NO_CONTEXT;
+#endif
+};
+
+inline Context::Context(int width, int height, const char* title, const ContextOptions& options)
+    : options_(options), width_(width), height_(height), start_(std::chrono::steady_clock::now()) {
+  TRACE_THREAD_NAME("main");
+  valid_ = (options_.headless ? createHeadless() : createWindow(width, height, title)) && loadFunctions();
+  if (valid_ && options_.headless) {
+    // color and depth the size the window would have had, standing in for the default framebuffer
+    glGenRenderbuffers(2, renderbuffers_);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers_[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers_[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cout << "Failed to create the offscreen framebuffer" << std::endl;
+      valid_ = false;
+    }
+    glViewport(0, 0, width, height);
+  }
+  pacer_ = std::make_unique<FramePacer>(pacingMode(), options_.fps, valid_ && window_);
+}
+
+inline Context::~Context() {
+  if (!options_.trace.empty() && !Trace::writeJson(options_.trace))
+    std::cout << "Failed to write the trace to " << options_.trace << std::endl;
+  if (options_.headless) {
+#ifdef HAVE_EGL
+    if (egl_context_ != EGL_NO_CONTEXT) {
+      if (framebuffer_) {
+        glDeleteFramebuffers(1, &framebuffer_);
+        glDeleteRenderbuffers(2, renderbuffers_);
+      }
+      eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      eglDestroyContext(display_, egl_context_);
+    }
+    if (display_ != EGL_NO_DISPLAY)
+      eglTerminate(display_);
+#endif
+    return;
+  }
+  glfwTerminate();
+}
+
+inline bool Context::createWindow(int width, int height, const char* title) {
+  TraceZone init("glfw init");
+  glfwInit();
+  init.end();
+  TraceZone create("create window");
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, options_.minor_version);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, options_.gl_debug ? GL_TRUE : GL_FALSE);
+
+  window_ = glfwCreateWindow(width, height, title, NULL, NULL);
+  if (window_ == NULL) {
+    std::cout << "Failed to create GLFW window" << std::endl;
+    return false;
+  }
+  glfwMakeContextCurrent(window_);
+  create.end();
+  glfwSetWindowUserPointer(window_, this);
+  glfwSetFramebufferSizeCallback(window_, framebufferSizeCallback);
+  glfwSetWindowRefreshCallback(window_, refreshCallback);
+  glfwSetKeyCallback(window_, keyCallback);
+  glfwSetCursorPosCallback(window_, cursorPosCallback);
+  glfwSetMouseButtonCallback(window_, mouseButtonCallback);
+  glfwSetScrollCallback(window_, scrollCallback);
+  return true;
+}
+
+inline bool Context::createHeadless() {
+#ifdef HAVE_EGL
+  // Mesa's surfaceless platform needs neither a display server nor a GPU, llvmpipe renders
+  TraceZone init("egl init");
+  auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay)
+    display_ = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (display_ == EGL_NO_DISPLAY)
+    display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, NULL, NULL)) {
+    std::cout << "Failed to initialize EGL" << std::endl;
+    return false;
+  }
+  init.end();
+
+  // no surface is ever created, but the default would ask for window support
+  const EGLint config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint config_count = 0;
+  if (!eglChooseConfig(display_, config_attributes, &config, 1, &config_count) || config_count == 0) {
+    std::cout << "Failed to find an EGL config for OpenGL" << std::endl;
+    return false;
+  }
+  eglBindAPI(EGL_OPENGL_API);
+  TraceZone create("create context");
+  const EGLint context_attributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, options_.minor_version,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_CONTEXT_OPENGL_DEBUG, options_.gl_debug ? EGL_TRUE : EGL_FALSE,
+    EGL_NONE
+  };
+  egl_context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attributes);
+  if (egl_context_ == EGL_NO_CONTEXT || !eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context_)) {
+    std::cout << "Failed to create a surfaceless EGL context" << std::endl;
+    return false;
+  }
+  return true;
+#else
+  std::cout << "Headless rendering needs EGL, which was not found at configure time" << std::endl;
+  return false;
+#endif
+}
+
+inline bool Context::loadFunctions() {
+  TraceZone load("glew init");
+  const GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  // a GLX build of GLEW loads the GL functions fine, it only misses the X display for GLX's own
+  if (status == GLEW_ERROR_NO_GLX_DISPLAY && options_.headless)
+    return true;
+#endif
+  if (status != GLEW_OK) {
+    std::cout << "Failed to initialize GLEW" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+inline FramePacer::Mode Context::pacingMode() const {
+  FramePacer::Mode mode = options_.headless ? FramePacer::Mode::Unlocked : FramePacer::Mode::Vsync;
+  if (options_.fps > 0.0)
+    mode = FramePacer::Mode::Cap;
+  if (!options_.pacing.empty() && !FramePacer::parse(options_.pacing.c_str(), mode))
+    std::cout << "Unknown pacing " << options_.pacing << ", using " << FramePacer::name(mode) << std::endl;
+  return mode;
+}
+
+inline void Context::reportPacing() {
+  const FramePacer::Stats stats = pacer_->takeStats();
+  std::cout << "Pacing " << FramePacer::name(pacer_->mode()) << ": " << stats.frames << " frames, "
+            << std::fixed << std::setprecision(2) << stats.frame_ms_avg << " ms avg, " << stats.frame_ms_stddev
+            << " stddev, " << stats.frame_ms_max << " max";
+  if (stats.inputs)
+    std::cout << ", input to swap " << stats.input_ms_avg << " ms avg, " << stats.input_ms_max << " max";
+  std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+inline void Context::framebufferSizeCallback(GLFWwindow* window, int width, int height) {
+  Context& context = of(window);
+  context.invalid_ = true;
+  if (context.framebuffer_size_callback_)
+    context.framebuffer_size_callback_(window, width, height);
+}
+
+inline void Context::refreshCallback(GLFWwindow* window) {
+  of(window).invalid_ = true;
+}
+
+inline void Context::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  Context& context = of(window);
+  context.invalid_ = true;
+  context.pacer_->input();
+  if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
+    context.reportPacing();
+    context.pacer_->nextMode();
+    std::cout << "Pacing now " << FramePacer::name(context.pacer_->mode()) << std::endl;
+  }
+  for (ContextObserver* observer : context.observers_)
+    observer->key(key, action);
+  if (context.key_callback_)
+    context.key_callback_(window, key, scancode, action, mods);
+}
+
+inline void Context::cursorPosCallback(GLFWwindow* window, double, double) {
+  of(window).invalid_ = true;
+  of(window).pacer_->input();
+}
+
+inline void Context::mouseButtonCallback(GLFWwindow* window, int, int, int) {
+  of(window).invalid_ = true;
+  of(window).pacer_->input();
+}
+
+inline void Context::scrollCallback(GLFWwindow* window, double, double) {
+  of(window).invalid_ = true;
+  of(window).pacer_->input();
+}
+
+inline void Context::framebufferSize(int* width, int* height) const {
+  if (window_) {
+    glfwGetFramebufferSize(window_, width, height);
+    return;
+  }
+  *width = width_;
+  *height = height_;
+}
+
+inline bool Context::shouldClose() const {
+  if (close_ || (options_.frames > 0 && frame_ >= options_.frames))
+    return true;
+  return window_ && glfwWindowShouldClose(window_);
+}
+
+inline void Context::setShouldClose() {
+  close_ = true;
+  if (window_)
+    glfwSetWindowShouldClose(window_, true);
+}
+
+inline void Context::removeObserver(ContextObserver* observer) {
+  observers_.erase(std::remove(observers_.begin(), observers_.end(), observer), observers_.end());
+}
+
+inline void Context::swapBuffers() {
+  for (ContextObserver* observer : observers_)
+    observer->beforeSwap();
+  {
+    TRACE_ZONE("pace");
+    pacer_->wait();
+  }
+  const uint64_t swap_begin = Trace::now();
+  {
+    TRACE_ZONE("swap");
+    if (window_)
+      glfwSwapBuffers(window_);
+    else
+      glFlush();
+  }
+  if (frame_ == 0)
+    Trace::record("first swap", swap_begin, Trace::now());
+  pacer_->presented();
+#ifdef TRACING
+  const uint64_t frame_end = Trace::now();
+  Trace::record("frame", frame_begin_, frame_end);
+  frame_begin_ = frame_end;
+#endif
+
+  for (ContextObserver* observer : observers_)
+    observer->afterSwap();
+  frame_++;
+}
+
+inline void Context::pollEvents() {
+  if (!window_)
+    return;
+  glfwPollEvents();
+  if (!options_.on_demand)
+    return;
+
+  TRACE_ZONE("idle");
+  // set before invalid_ is looked at, so an invalidate() from another thread either
+  // sees it and wakes the wait or comes early enough to keep the loop from waiting
+  waiting_ = true;
+  while (!invalid_ && !shouldClose()) {
+    if (redraw_at_ == std::chrono::steady_clock::time_point::max()) {
+      glfwWaitEvents();
+      continue;
+    }
+    const double seconds = std::chrono::duration<double>(redraw_at_ - std::chrono::steady_clock::now()).count();
+    if (seconds <= 0.0)
+      break;
+    glfwWaitEventsTimeout(seconds);
+  }
+  // the frame about to be drawn, whatever invalidates it from here on is for the next;
+  // cleared while still waiting, so an invalidate() in between posts its event
+  invalid_ = false;
+  waiting_ = false;
+  redraw_at_ = std::chrono::steady_clock::time_point::max();
+}
+
+inline void Context::invalidate() {
+  // only the first call wakes the loop, and only while it waits, not every frame of an animation
+  if (!invalid_.exchange(true) && waiting_ && window_ && options_.on_demand)
+    glfwPostEmptyEvent();
+}
+
+inline void Context::invalidate(double seconds) {
+  const auto at = std::chrono::steady_clock::now() +
+                  std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+  redraw_at_ = std::min(redraw_at_, at);
+}
+
+inline double Context::time() const {
+  if (options_.fixed_step)
+    return frame_ / 60.0;
+  if (window_)
+    return glfwGetTime();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+}
+
+#endif
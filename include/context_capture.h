@@ -0,0 +1,77 @@
+#ifndef CONTEXT_CAPTURE_H
+#define CONTEXT_CAPTURE_H
+
+#include <memory>
+#include <string>
+
+#include "Config.h"
+#include "context.h"
+#include "frame_capture.h"
+
+// With --capture the last frame, or with --capture-every every Nth one, is read back
+// right before its swap, through FrameCapture so the frames after it do not wait
+// for the readback or the PNG encoding. The last captures are written when it goes,
+// before the context.
+class ContextCapture : public ContextObserver {
+public:
+  explicit ContextCapture(Context& context);
+  ~ContextCapture() override;
+
+  void beforeSwap() override;
+
+private:
+  bool enabled() const { return context_.valid() && !context_.options().capture.empty(); }
+  bool capturing() const;
+  std::string capturePath() const;
+
+  Context& context_;
+  std::unique_ptr<FrameCapture> capture_;   // created with the first capture
+};
+
+inline ContextCapture::ContextCapture(Context& context) : context_(context) {
+  if (enabled())
+    context_.addObserver(this);
+}
+
+inline ContextCapture::~ContextCapture() {
+  if (enabled())
+    context_.removeObserver(this);
+  capture_.reset();
+}
+
+inline void ContextCapture::beforeSwap() {
+  if (capturing()) {
+    if (!capture_)
+      capture_ = std::make_unique<FrameCapture>();
+    // the window's framebuffer may have been resized, or be larger than the window on HiDPI
+    int width = 0, height = 0;
+    context_.framebufferSize(&width, &height);
+    capture_->capture(context_.framebuffer(), width, height, capturePath());
+  }
+  else if (capture_) {
+    capture_->poll();
+  }
+}
+
+inline bool ContextCapture::capturing() const {
+  const ContextOptions& options = context_.options();
+  if (options.capture_every > 0)
+    return context_.frame() % options.capture_every == 0;
+  return context_.frame() == options.frames - 1;
+}
+
+inline std::string ContextCapture::capturePath() const {
+  const ContextOptions& options = context_.options();
+  if (options.capture_every <= 0)
+    return options.capture;
+  // name.png becomes name_0042.png
+  std::string number = std::to_string(context_.frame());
+  number.insert(0, number.size() < 4 ? 4 - number.size() : 0, '0');
+  const size_t slash = options.capture.find_last_of("/\\");
+  const size_t dot = options.capture.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return options.capture + "_" + number;
+  return options.capture.substr(0, dot) + "_" + number + options.capture.substr(dot);
+}
+
+#endif
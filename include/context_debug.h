@@ -0,0 +1,52 @@
+#ifndef CONTEXT_DEBUG_H
+#define CONTEXT_DEBUG_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+
+#include "Config.h"
+#include "context.h"
+#include "gl_debug.h"
+#include "gl_objects.h"
+
+// With --gl-debug GLDebug collects the debug context's messages from the moment this
+// is created, and what it got is reported to cerr when this goes. F2 lists the GL
+// objects alive, and the ones still alive when this goes are reported as leaks. The
+// samples create it first thing after the context, so it sees their setup and
+// reports once the other observers are gone.
+class ContextDebug : public ContextObserver {
+public:
+  explicit ContextDebug(Context& context);
+  ~ContextDebug() override;
+
+  void key(int key, int action) override;
+
+private:
+  Context& context_;
+};
+
+inline ContextDebug::ContextDebug(Context& context) : context_(context) {
+  if (!context_.valid())
+    return;
+  context_.addObserver(this);
+  if (context_.options().gl_debug && !GLDebug::enable())
+    std::cout << "The context has no KHR_debug, --gl-debug reports nothing" << std::endl;
+  GLDebug::label(GL_FRAMEBUFFER, context_.framebuffer(), "offscreen framebuffer");
+}
+
+inline ContextDebug::~ContextDebug() {
+  if (!context_.valid())
+    return;
+  context_.removeObserver(this);
+  GLObjects::reportLeaks(std::cout);
+  GLDebug::report(std::cerr);
+}
+
+inline void ContextDebug::key(int key, int action) {
+  if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+    GLObjects::report(std::cout);
+}
+
+#endif
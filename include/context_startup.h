@@ -0,0 +1,120 @@
+#ifndef CONTEXT_STARTUP_H
+#define CONTEXT_STARTUP_H
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Config.h"
+#include "context.h"
+#include "trace.h"
+
+// With --startup, once the first frame is swapped, every trace zone that began
+// before the swap ended is summed up by name: the context's creation steps and its
+// first swap, and the samples' shader builds and texture loads among them when
+// TRACING is on. The time on the main thread that no zone covers is counted as
+// well. Printed and written as JSON; only what happened before it was created and
+// the first swap can be accounted for, so the samples create it right after the
+// context.
+class ContextStartup : public ContextObserver {
+public:
+  explicit ContextStartup(Context& context);
+  ~ContextStartup() override;
+
+  void afterSwap() override;
+
+private:
+  bool reporting() const { return context_.valid() && !context_.options().startup.empty(); }
+  void write();
+
+  Context& context_;
+};
+
+inline ContextStartup::ContextStartup(Context& context) : context_(context) {
+  if (reporting())
+    context_.addObserver(this);
+}
+
+inline ContextStartup::~ContextStartup() {
+  if (reporting())
+    context_.removeObserver(this);
+}
+
+inline void ContextStartup::afterSwap() {
+  if (context_.frame() == 0)
+    write();
+}
+
+inline void ContextStartup::write() {
+  struct Phase {
+    const char* name;
+    size_t count;
+    double start_ms, total_ms;
+  };
+  const std::vector<Trace::Zone> zones = Trace::zones();
+  const uint32_t main_thread = Trace::threadId();
+  double first_frame_ms = 0.0;
+  for (const Trace::Zone& zone : zones)
+    if (zone.thread == main_thread && std::strcmp(zone.name, "first swap") == 0)
+      first_frame_ms = zone.end_ms;
+
+  // by name in the order they first began, and the main thread's outermost zones
+  std::vector<Phase> phases;
+  std::vector<std::pair<double, double>> outermost;
+  for (const Trace::Zone& zone : zones) {
+    if (zone.begin_ms > first_frame_ms)
+      continue;
+    auto phase = std::find_if(phases.begin(), phases.end(),
+                              [&](const Phase& phase) { return std::strcmp(phase.name, zone.name) == 0; });
+    if (phase == phases.end())
+      phase = phases.insert(phases.end(), Phase{zone.name, 0, zone.begin_ms, 0.0});
+    phase->count++;
+    phase->start_ms = std::min(phase->start_ms, zone.begin_ms);
+    phase->total_ms += zone.end_ms - zone.begin_ms;
+    if (zone.thread == main_thread)
+      outermost.emplace_back(zone.begin_ms, zone.end_ms);
+  }
+  std::stable_sort(phases.begin(), phases.end(),
+                   [](const Phase& a, const Phase& b) { return a.start_ms < b.start_ms; });
+  std::sort(outermost.begin(), outermost.end());
+  double covered_ms = 0.0, covered_until = 0.0;
+  for (const auto& zone : outermost) {
+    if (zone.second <= covered_until)
+      continue;   // inside one counted already
+    covered_ms += zone.second - std::max(zone.first, covered_until);
+    covered_until = zone.second;
+  }
+  const double unaccounted_ms = std::max(0.0, first_frame_ms - covered_ms);
+
+  std::cout << "Startup " << std::fixed << std::setprecision(1) << first_frame_ms << " ms to the first frame"
+            << std::endl;
+  std::cout << "  " << std::left << std::setw(24) << "phase" << std::right << std::setw(7) << "count"
+            << std::setw(11) << "start ms" << std::setw(11) << "total ms" << std::endl;
+  for (const Phase& phase : phases)
+    std::cout << "  " << std::left << std::setw(24) << phase.name << std::right << std::setw(7) << phase.count
+              << std::setw(11) << phase.start_ms << std::setw(11) << phase.total_ms << std::endl;
+  std::cout << "  " << std::left << std::setw(42) << "outside any zone" << std::right << std::setw(11)
+            << unaccounted_ms << std::defaultfloat << std::setprecision(6) << std::endl;
+
+  const std::string& path = context_.options().startup;
+  std::ofstream file(path);
+  if (!file) {
+    std::cout << "Failed to write the startup times to " << path << std::endl;
+    return;
+  }
+  file << "{\n"
+       << "  \"first_frame_ms\": " << first_frame_ms << ",\n"
+       << "  \"unaccounted_ms\": " << unaccounted_ms << ",\n"
+       << "  \"phases\": {";
+  for (size_t i = 0; i < phases.size(); i++)
+    file << (i ? "," : "") << "\n    \"" << phases[i].name << "\": {\"count\": " << phases[i].count
+         << ", \"start_ms\": " << phases[i].start_ms << ", \"total_ms\": " << phases[i].total_ms << "}";
+  file << "\n  }\n}\n";
+}
+
+#endif
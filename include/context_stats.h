@@ -0,0 +1,169 @@
+#ifndef CONTEXT_STATS_H
+#define CONTEXT_STATS_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "Config.h"
+#include "context.h"
+#include "gl_debug.h"
+#include "gl_objects.h"
+
+// With --stats every frame is timed, on the CPU from swap to swap and on the GPU with
+// a timer query around everything between two swaps, read back a few frames late.
+// A GPU time still not available by then is dropped rather than waited for, only the
+// last few are waited for when it goes. Startup is the time from the process start
+// to the first swap.
+// The GL objects alive at the last swap and how many the frames after the first
+// created, which should be none, come from GLObjects; the draw calls are the ones
+// the sample counted on the context. With --gl-debug the errors and performance
+// warnings are counted too. Written as JSON when it goes, before the context.
+class ContextStats : public ContextObserver {
+public:
+  explicit ContextStats(Context& context);
+  ~ContextStats() override;
+
+  void beforeSwap() override;
+  void afterSwap() override;
+
+private:
+  static constexpr int TIMER_QUERIES = 4;   // frames in flight before a GPU time is read back
+
+  bool recording() const { return context_.valid() && !context_.options().stats.empty(); }
+  // the GPU time of the frame, unless it is not available and wait is false
+  void readTimerQuery(int frame, bool wait);
+  void write();
+
+  Context& context_;
+  std::chrono::steady_clock::time_point last_swap_;
+  double startup_ms_ = 0.0;
+  size_t gl_objects_ = 0, gl_bytes_ = 0;
+  size_t gl_objects_created_ = 0;   // after the first frame
+  std::vector<double> cpu_ms_, gpu_ms_;
+  GLuint timer_queries_[TIMER_QUERIES] = {};
+  int pending_queries_ = 0;   // issued and not read back, the newest still running
+};
+
+inline ContextStats::ContextStats(Context& context) : context_(context) {
+  if (!recording())
+    return;
+  context_.addObserver(this);
+  glGenQueries(TIMER_QUERIES, timer_queries_);
+  glBeginQuery(GL_TIME_ELAPSED, timer_queries_[context_.frame() % TIMER_QUERIES]);
+  pending_queries_ = 1;
+}
+
+inline ContextStats::~ContextStats() {
+  if (!recording())
+    return;
+  context_.removeObserver(this);
+  write();
+}
+
+inline void ContextStats::beforeSwap() {
+  // the query running since the last swap ends; with the ring full the oldest one is
+  // read back if it is done, and dropped if not
+  glEndQuery(GL_TIME_ELAPSED);
+  const int next = (context_.frame() + 1) % TIMER_QUERIES;
+  if (pending_queries_ == TIMER_QUERIES) {
+    readTimerQuery(context_.frame() + 1 - TIMER_QUERIES, false);
+    pending_queries_--;
+  }
+  glBeginQuery(GL_TIME_ELAPSED, timer_queries_[next]);
+  pending_queries_++;
+}
+
+inline void ContextStats::afterSwap() {
+  // objects created once the first frame is out are churn
+  const GLObjects::Stats objects = GLObjects::takeStats();
+  if (context_.frame() > 0)
+    gl_objects_created_ += objects.created;
+  gl_objects_ = GLObjects::count();
+  gl_bytes_ = GLObjects::bytes();
+
+  const auto now = std::chrono::steady_clock::now();
+  if (context_.frame() == 0)
+    startup_ms_ = std::chrono::duration<double, std::milli>(now - PROCESS_START).count();
+  else
+    cpu_ms_.push_back(std::chrono::duration<double, std::milli>(now - last_swap_).count());
+  last_swap_ = now;
+}
+
+inline void ContextStats::readTimerQuery(int frame, bool wait) {
+  const GLuint query = timer_queries_[frame % TIMER_QUERIES];
+  if (!wait) {
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return;
+  }
+  GLuint64 elapsed = 0;
+  glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+  // the first frame is part of the startup, not of the steady state
+  if (frame > 0)
+    gpu_ms_.push_back(elapsed * 1e-6);
+}
+
+inline void ContextStats::write() {
+  const int frames = context_.frame();
+  // the query still running covers no frame, the ones before it are complete
+  glEndQuery(GL_TIME_ELAPSED);
+  for (int i = pending_queries_ - 1; i > 0; i--)
+    readTimerQuery(frames - i, true);
+  glDeleteQueries(TIMER_QUERIES, timer_queries_);
+
+  const std::string& path = context_.options().stats;
+  std::ofstream file(path);
+  if (!file) {
+    std::cout << "Failed to write the frame statistics to " << path << std::endl;
+    return;
+  }
+  // nearest rank percentiles
+  auto percentile = [](std::vector<double> values, double p) {
+    if (values.empty())
+      return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p / 100.0 * values.size()))];
+  };
+  auto stddev = [](const std::vector<double>& values) {
+    if (values.size() < 2)
+      return 0.0;
+    double mean = 0.0, squares = 0.0;
+    for (double value : values)
+      mean += value / values.size();
+    for (double value : values)
+      squares += (value - mean) * (value - mean);
+    return std::sqrt(squares / (values.size() - 1));
+  };
+  file << "{\n"
+       << "  \"frames\": " << frames << ",\n"
+       << "  \"startup_ms\": " << startup_ms_ << ",\n"
+       << "  \"cpu_frame_ms_p50\": " << percentile(cpu_ms_, 50) << ",\n"
+       << "  \"cpu_frame_ms_p90\": " << percentile(cpu_ms_, 90) << ",\n"
+       << "  \"cpu_frame_ms_p99\": " << percentile(cpu_ms_, 99) << ",\n"
+       << "  \"cpu_frame_ms_stddev\": " << stddev(cpu_ms_) << ",\n"
+       << "  \"gpu_frame_ms_p50\": " << percentile(gpu_ms_, 50) << ",\n"
+       << "  \"gpu_frame_ms_p90\": " << percentile(gpu_ms_, 90) << ",\n"
+       << "  \"gpu_frame_ms_p99\": " << percentile(gpu_ms_, 99) << ",\n"
+       << "  \"draw_calls_per_frame\": " << (frames ? (double)context_.draws() / frames : 0.0) << ",\n"
+       << "  \"gl_objects\": " << gl_objects_ << ",\n"
+       << "  \"gl_mb\": " << gl_bytes_ / (1024.0 * 1024.0) << ",\n"
+       << "  \"gl_objects_created_per_frame\": "
+       << (frames > 1 ? (double)gl_objects_created_ / (frames - 1) : 0.0);
+  if (GLDebug::enabled()) {
+    const GLDebug::Stats debug = GLDebug::stats();
+    file << ",\n"
+         << "  \"gl_debug_errors\": " << debug.messages[GLDebug::ERROR] << ",\n"
+         << "  \"gl_debug_performance_warnings\": " << debug.messages[GLDebug::PERFORMANCE] << ",\n"
+         << "  \"gl_debug_warnings\": " << debug.messages[GLDebug::WARNING];
+  }
+  file << "\n}\n";
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef CONTEXT_TOOLS_H
+#define CONTEXT_TOOLS_H
+
+#include "Config.h"
+#include "context.h"
+#include "context_capture.h"
+#include "context_debug.h"
+#include "context_startup.h"
+#include "context_stats.h"
+
+// Every observer the command line can ask for, each doing nothing without its
+// option, so a sample that declares this right after its context takes all of them.
+// ContextDebug comes first so it goes last, once the others released what they held.
+struct ContextTools {
+  explicit ContextTools(Context& context) : debug(context), startup(context), stats(context), capture(context) {}
+
+  ContextDebug debug;
+  ContextStartup startup;
+  ContextStats stats;
+  ContextCapture capture;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#include <GL/glew.h>
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "Config.h"
+#include "shader.h"
+
+// Hierarchical depth buffer for occlusion culling (needs GL 4.3 compute).
+// Every mip level stores the farthest depth of the texels it covers, so a box whose
+// nearest depth is behind the texels under its screen rectangle is hidden. The pyramid
+// is built from the depth of the previous frame, the only one available before culling.
+class DepthPyramid {
+public:
+  enum class Mode {
+    // test the bounds projected with last frame's camera against last frame's depth,
+    // cheap but objects revealed by the camera motion show up a frame late
+    PreviousFrame,
+    // first scatter last frame's depth into the current view, keeping the farthest
+    // depth where texels collide and the far plane in the holes, and test with the
+    // current camera: it never hides what the current view reveals, only what moved
+    Reprojected
+  };
+
+  DepthPyramid(GLsizei width, GLsizei height);
+  ~DepthPyramid();
+
+  // match the size of the depth textures passed to build()
+  void resize(GLsizei width, GLsizei height);
+
+  // build from depth_texture, rendered with depth_view_projection, for testing bounds
+  // seen by view_projection
+  void build(GLuint depth_texture, const glm::mat4& depth_view_projection,
+             const glm::mat4& view_projection);
+
+  void setMode(Mode mode) { mode_ = mode; }
+  Mode mode() const { return mode_; }
+
+  GLuint texture() const { return texture_; }
+  GLsizei width() const { return width_; }
+  GLsizei height() const { return height_; }
+  GLint levels() const { return levels_; }
+  // matrix to project the bounds with before testing them against the pyramid
+  const glm::mat4& viewProjection() const { return view_projection_; }
+
+private:
+  static constexpr int LOCAL_SIZE = 8;
+
+  void allocate();
+  void release();
+  void dispatch(GLsizei width, GLsizei height) const;
+
+  ShaderProgram reproject_program_;
+  ShaderProgram init_program_;
+  ShaderProgram downsample_program_;
+  GLint reprojection_loc_, reprojected_loc_;
+
+  Mode mode_ = Mode::Reprojected;
+  GLsizei width_, height_;
+  GLint levels_ = 0;
+  GLuint texture_ = 0;
+  GLuint reprojected_texture_ = 0;  // r32ui target of the reprojection, zero meaning empty
+  glm::mat4 view_projection_ = glm::mat4(1.0f);
+};
+
+inline DepthPyramid::DepthPyramid(GLsizei width, GLsizei height)
+    : reproject_program_(SHADER_DIR "/depth_pyramid/reproject.comp"),
+      init_program_(SHADER_DIR "/depth_pyramid/init.comp"),
+      downsample_program_(SHADER_DIR "/depth_pyramid/downsample.comp"),
+      width_(width), height_(height) {
+  reprojection_loc_ = glGetUniformLocation(reproject_program_.ID, "reprojection");
+  reprojected_loc_ = glGetUniformLocation(init_program_.ID, "reprojected");
+  reproject_program_.use();
+  reproject_program_.setInt("depthTexture", 0);
+  init_program_.use();
+  init_program_.setInt("depthTexture", 0);
+  allocate();
+}
+
+inline DepthPyramid::~DepthPyramid() {
+  release();
+}
+
+inline void DepthPyramid::resize(GLsizei width, GLsizei height) {
+  if (width == width_ && height == height_)
+    return;
+  width_ = width;
+  height_ = height;
+  release();
+  allocate();
+}
+
+inline void DepthPyramid::allocate() {
+  levels_ = 1;
+  while ((std::max(width_, height_) >> levels_) > 0)
+    levels_++;
+
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexStorage2D(GL_TEXTURE_2D, levels_, GL_R32F, width_, height_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // starts out empty, afterwards the init pass empties it again once read
+  const std::vector<GLuint> empty(width_ * height_, 0);
+  glGenTextures(1, &reprojected_texture_);
+  glBindTexture(GL_TEXTURE_2D, reprojected_texture_);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, width_, height_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_, GL_RED_INTEGER, GL_UNSIGNED_INT, empty.data());
+}
+
+inline void DepthPyramid::release() {
+  glDeleteTextures(1, &reprojected_texture_);
+  glDeleteTextures(1, &texture_);
+}
+
+inline void DepthPyramid::dispatch(GLsizei width, GLsizei height) const {
+  glDispatchCompute((width + LOCAL_SIZE - 1) / LOCAL_SIZE, (height + LOCAL_SIZE - 1) / LOCAL_SIZE, 1);
+}
+
+inline void DepthPyramid::build(GLuint depth_texture, const glm::mat4& depth_view_projection,
+                                const glm::mat4& view_projection) {
+  const bool reprojected = mode_ == Mode::Reprojected;
+  view_projection_ = reprojected ? view_projection : depth_view_projection;
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, depth_texture);
+  glBindImageTexture(0, reprojected_texture_, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+  if (reprojected) {
+    reproject_program_.use();
+    const glm::mat4 reprojection = view_projection * glm::inverse(depth_view_projection);
+    glUniformMatrix4fv(reprojection_loc_, 1, GL_FALSE, &reprojection[0][0]);
+    dispatch(width_, height_);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+
+  init_program_.use();
+  glUniform1i(reprojected_loc_, reprojected);
+  glBindImageTexture(1, texture_, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  dispatch(width_, height_);
+
+  // each level keeps the farthest depth of the 2x2 (3x3 at odd edges) texels below it
+  downsample_program_.use();
+  for (GLint level = 1; level < levels_; level++) {
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(0, texture_, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    glBindImageTexture(1, texture_, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    dispatch(std::max(width_ >> level, 1), std::max(height_ >> level, 1));
+  }
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Sine and cosine for animation loops: the angle is reduced to [-pi/4, pi/4] around
+// the nearest multiple of pi/2 and both functions come from the same reduction.
+// Fast is off by at most about 1e-5, Accurate by about 1e-7 (single precision
+// rounding), for angles up to a few thousand radians.
+enum class TrigPrecision { Fast, Accurate };
+
+namespace fast_math_detail {
+
+// pi/2 split in three so k * pi/2 is subtracted without rounding for moderate k
+const float PIO2_HI = 1.5703125f;
+const float PIO2_MID = 4.837512969970703125e-4f;
+const float PIO2_LO = 7.54978995489188216e-8f;
+const float TWO_OVER_PI = 0.636619772367581343f;
+
+// minimax fits on [-pi/4, pi/4] for Fast, the cephes sinf/cosf polynomials for Accurate
+const float FAST_SIN[2] = {-1.6662833776e-1f, 8.1529916515e-3f};
+const float FAST_COS[2] = {-4.9977630515e-1f, 4.0488930992e-2f};
+const float ACCURATE_SIN[3] = {-1.6666654611e-1f, 8.3321608736e-3f, -1.9515295891e-4f};
+const float ACCURATE_COS[3] = {4.166664568298827e-2f, -1.388731625493765e-3f, 2.443315711809948e-5f};
+
+}
+
+// one angle at a time
+inline void fastSinCos(float angle, float& sine, float& cosine, TrigPrecision precision = TrigPrecision::Accurate) {
+  using namespace fast_math_detail;
+  const float k = std::nearbyint(angle * TWO_OVER_PI);
+  const int quadrant = (int)k;
+  const float x = ((angle - k * PIO2_HI) - k * PIO2_MID) - k * PIO2_LO;
+  const float z = x * x;
+  float s, c;
+  if (precision == TrigPrecision::Fast) {
+    s = x + x * z * (FAST_SIN[0] + z * FAST_SIN[1]);
+    c = 1.0f + z * (FAST_COS[0] + z * FAST_COS[1]);
+  }
+  else {
+    s = x + x * z * (ACCURATE_SIN[0] + z * (ACCURATE_SIN[1] + z * ACCURATE_SIN[2]));
+    c = 1.0f - 0.5f * z + z * z * (ACCURATE_COS[0] + z * (ACCURATE_COS[1] + z * ACCURATE_COS[2]));
+  }
+  // sin(x + k pi/2) and cos(x + k pi/2) swap and change sign with the quadrant
+  const float swapped_s = (quadrant & 1) ? c : s;
+  const float swapped_c = (quadrant & 1) ? s : c;
+  sine = (quadrant & 2) ? -swapped_s : swapped_s;
+  cosine = ((quadrant + 1) & 2) ? -swapped_c : swapped_c;
+}
+
+// sines[i] and cosines[i] of angles[i] for count angles, four at a time with SSE2
+inline void fastSinCos(const float* angles, float* sines, float* cosines, size_t count,
+                       TrigPrecision precision = TrigPrecision::Accurate) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  using namespace fast_math_detail;
+  const __m128 two_over_pi = _mm_set1_ps(TWO_OVER_PI);
+  const __m128 pio2_hi = _mm_set1_ps(PIO2_HI), pio2_mid = _mm_set1_ps(PIO2_MID), pio2_lo = _mm_set1_ps(PIO2_LO);
+  const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+  const __m128i int_one = _mm_set1_epi32(1);
+  const __m128 sign_bit = _mm_set1_ps(-0.0f);
+  const bool fast = precision == TrigPrecision::Fast;
+  // whole groups of 4, the rest goes through the scalar loop below
+  const size_t simd_count = count - count % 4;
+  for (; i < simd_count; i += 4) {
+    const __m128 angle = _mm_loadu_ps(angles + i);
+    const __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(angle, two_over_pi));   // rounds to nearest
+    const __m128 k = _mm_cvtepi32_ps(quadrant);
+    __m128 x = _mm_sub_ps(angle, _mm_mul_ps(k, pio2_hi));
+    x = _mm_sub_ps(x, _mm_mul_ps(k, pio2_mid));
+    x = _mm_sub_ps(x, _mm_mul_ps(k, pio2_lo));
+    const __m128 z = _mm_mul_ps(x, x);
+
+    __m128 s, c;
+    if (fast) {
+      s = _mm_add_ps(_mm_set1_ps(FAST_SIN[0]), _mm_mul_ps(z, _mm_set1_ps(FAST_SIN[1])));
+      s = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, z), s));
+      c = _mm_add_ps(_mm_set1_ps(FAST_COS[0]), _mm_mul_ps(z, _mm_set1_ps(FAST_COS[1])));
+      c = _mm_add_ps(one, _mm_mul_ps(z, c));
+    }
+    else {
+      s = _mm_add_ps(_mm_set1_ps(ACCURATE_SIN[1]), _mm_mul_ps(z, _mm_set1_ps(ACCURATE_SIN[2])));
+      s = _mm_add_ps(_mm_set1_ps(ACCURATE_SIN[0]), _mm_mul_ps(z, s));
+      s = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, z), s));
+      c = _mm_add_ps(_mm_set1_ps(ACCURATE_COS[1]), _mm_mul_ps(z, _mm_set1_ps(ACCURATE_COS[2])));
+      c = _mm_add_ps(_mm_set1_ps(ACCURATE_COS[0]), _mm_mul_ps(z, c));
+      c = _mm_add_ps(_mm_sub_ps(one, _mm_mul_ps(half, z)), _mm_mul_ps(_mm_mul_ps(z, z), c));
+    }
+
+    const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, int_one), int_one));
+    const __m128 swapped_s = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+    const __m128 swapped_c = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+    // bit 1 of the quadrant moved to the sign bit
+    const __m128 sin_sign = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(quadrant, 30)), sign_bit);
+    const __m128 cos_sign = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(quadrant, int_one), 30)), sign_bit);
+    _mm_storeu_ps(sines + i, _mm_xor_ps(swapped_s, sin_sign));
+    _mm_storeu_ps(cosines + i, _mm_xor_ps(swapped_c, cos_sign));
+  }
+#endif
+  for (; i < count; i++)
+    fastSinCos(angles[i], sines[i], cosines[i], precision);
+}
+
+// m * rotation about one coordinate axis from its sine and cosine, the same as
+// glm::rotate(m, angle, axis) for that axis but touching only the two columns that change
+inline glm::mat4 rotateX(const glm::mat4& m, float sine, float cosine) {
+  glm::mat4 result = m;
+  result[1] = m[1] * cosine + m[2] * sine;
+  result[2] = m[2] * cosine - m[1] * sine;
+  return result;
+}
+
+inline glm::mat4 rotateY(const glm::mat4& m, float sine, float cosine) {
+  glm::mat4 result = m;
+  result[0] = m[0] * cosine - m[2] * sine;
+  result[2] = m[2] * cosine + m[0] * sine;
+  return result;
+}
+
+inline glm::mat4 rotateZ(const glm::mat4& m, float sine, float cosine) {
+  glm::mat4 result = m;
+  result[0] = m[0] * cosine + m[1] * sine;
+  result[1] = m[1] * cosine - m[0] * sine;
+  return result;
+}
+
+inline glm::mat4 rotateX(const glm::mat4& m, float angle, TrigPrecision precision = TrigPrecision::Accurate) {
+  float sine, cosine;
+  fastSinCos(angle, sine, cosine, precision);
+  return rotateX(m, sine, cosine);
+}
+
+inline glm::mat4 rotateY(const glm::mat4& m, float angle, TrigPrecision precision = TrigPrecision::Accurate) {
+  float sine, cosine;
+  fastSinCos(angle, sine, cosine, precision);
+  return rotateY(m, sine, cosine);
+}
+
+inline glm::mat4 rotateZ(const glm::mat4& m, float angle, TrigPrecision precision = TrigPrecision::Accurate) {
+  float sine, cosine;
+  fastSinCos(angle, sine, cosine, precision);
+  return rotateZ(m, sine, cosine);
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "png.h"
+#include "trace.h"
+
+// Reads frames back to PNG files without stalling the render loop. capture() only
+// queues a glReadPixels into a pixel pack buffer and a fence behind it; a few frames
+// later, once the fence has signalled, the buffer is mapped and copied out, and a
+// worker thread flips, encodes and writes the image. The GL thread only ever waits
+// when more captures are in flight than there are buffers. Every capture is the
+// size the framebuffer has at the time, a buffer is reallocated when that changes.
+class FrameCapture {
+public:
+  static constexpr int BUFFERS = 3;
+
+  // needs the context current
+  FrameCapture();
+  // waits for the captures in flight and the encoder, with the context still current
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture&) = delete;
+  FrameCapture& operator=(const FrameCapture&) = delete;
+
+  // the color of framebuffer as it is once the commands so far ran, 0 the window's back buffer,
+  // width by height pixels from its lower left corner
+  void capture(GLuint framebuffer, int width, int height, const std::string& path);
+  // hands the readbacks the GPU is done with to the encoder, waiting for all of them with wait
+  void poll(bool wait = false);
+
+private:
+  struct Readback {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    int width = 0, height = 0;   // of the capture in the buffer, the size it was allocated with
+    std::string path;
+  };
+
+  struct Image {
+    std::string path;
+    int width, height;
+    std::vector<uint8_t> rgba;   // bottom row first, as GL reads it
+  };
+
+  void encodeLoop();
+
+  Readback readbacks_[BUFFERS];
+  int next_ = 0;      // the next buffer capture() uses, the oldest in flight
+  int pending_ = 0;   // captures in flight
+
+  std::thread encoder_;
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::deque<Image> images_;
+  bool stop_ = false;
+};
+
+inline FrameCapture::FrameCapture() {
+  // allocated with their first capture
+  for (Readback& readback : readbacks_)
+    glGenBuffers(1, &readback.buffer);
+  encoder_ = std::thread(&FrameCapture::encodeLoop, this);
+}
+
+inline FrameCapture::~FrameCapture() {
+  poll(true);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  queued_.notify_one();
+  encoder_.join();
+  for (Readback& readback : readbacks_)
+    glDeleteBuffers(1, &readback.buffer);
+}
+
+inline void FrameCapture::capture(GLuint framebuffer, int width, int height, const std::string& path) {
+  TRACE_ZONE("capture");
+  poll();
+  if (width <= 0 || height <= 0)
+    return;   // a minimized window
+  if (pending_ == BUFFERS) {
+    // every buffer in flight, the oldest has to come back first
+    const Readback& oldest = readbacks_[(next_ - pending_ + BUFFERS) % BUFFERS];
+    glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    poll();
+  }
+
+  // the sample's bindings stay as they were
+  GLint read_framebuffer = 0, pack_buffer = 0, pack_alignment = 0;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+  glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack_buffer);
+  glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+
+  Readback& readback = readbacks_[next_];
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  if (readback.width != width || readback.height != height) {
+    // not in flight, the framebuffer was resized since the buffer was last used
+    glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+    readback.width = width;
+    readback.height = height;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.path = path;
+  next_ = (next_ + 1) % BUFFERS;
+  pending_++;
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+}
+
+inline void FrameCapture::poll(bool wait) {
+  if (pending_ == 0)
+    return;
+  GLint pack_buffer = 0;
+  glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack_buffer);
+  // oldest first, the fences signal in order
+  while (pending_ > 0) {
+    Readback& readback = readbacks_[(next_ - pending_ + BUFFERS) % BUFFERS];
+    const GLenum status = glClientWaitSync(readback.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                           wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      break;
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    pending_--;
+
+    Image image;
+    image.path = readback.path;
+    image.width = readback.width;
+    image.height = readback.height;
+    image.rgba.resize((size_t)image.width * image.height * 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, image.rgba.size(), GL_MAP_READ_BIT);
+    if (pixels) {
+      std::memcpy(image.rgba.data(), pixels, image.rgba.size());
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      std::lock_guard<std::mutex> lock(mutex_);
+      images_.push_back(std::move(image));
+      queued_.notify_one();
+    }
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+}
+
+inline void FrameCapture::encodeLoop() {
+  TRACE_THREAD_NAME("capture encoder");
+  while (true) {
+    Image image;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.wait(lock, [this] { return stop_ || !images_.empty(); });
+      if (images_.empty())
+        return;
+      image = std::move(images_.front());
+      images_.pop_front();
+    }
+    TRACE_ZONE("encode png");
+    // top row first and without alpha, the framebuffer's alpha is whatever blending left
+    const size_t stride = (size_t)image.width * 3;
+    std::vector<uint8_t> rgb(stride * image.height);
+    for (int y = 0; y < image.height; y++) {
+      const uint8_t* source = image.rgba.data() + (size_t)(image.height - 1 - y) * image.width * 4;
+      uint8_t* destination = rgb.data() + y * stride;
+      for (int x = 0; x < image.width; x++)
+        std::memcpy(destination + 3 * x, source + 4 * x, 3);
+    }
+    if (!writePng(image.path, image.width, image.height, 3, rgb.data()))
+      std::cerr << "Failed to write " << image.path << std::endl;
+  }
+}
+
+#endif
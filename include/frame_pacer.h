@@ -0,0 +1,173 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+// When frames are presented, one of:
+//   vsync      swap interval 1, the swap blocks until the next vertical blank
+//   adaptive   swap interval -1 with (GLX|WGL)_EXT_swap_control_tear, a late frame tears
+//              instead of waiting a whole refresh; vsync where the extension is missing
+//   cap        swap interval 0 and at most fps frames a second, paced on the CPU
+//   unlocked   swap interval 0, as fast as the GPU goes
+// The cap sleeps until shortly before each frame's deadline and spins the rest, since
+// a plain sleep overshoots by the scheduler's granularity, often a millisecond or more.
+// Deadlines advance by one period, so a late frame is caught up on the next instead of
+// shifting every frame after it; a frame more than a period late starts over.
+//
+// Frame times are measured from one presented() to the next and input latency from
+// the first input() after a frame to the presented() that follows, which is as close
+// to the display as the CPU gets. takeStats() returns both since the last call.
+class FramePacer {
+public:
+  enum class Mode { Vsync, Adaptive, Cap, Unlocked };
+
+  struct Stats {
+    size_t frames = 0;
+    double frame_ms_avg = 0.0, frame_ms_stddev = 0.0, frame_ms_max = 0.0;
+    size_t inputs = 0;   // frames that had input
+    double input_ms_avg = 0.0, input_ms_max = 0.0;
+  };
+
+  static constexpr double SPIN_MS = 1.5;   // the part of the wait spent spinning, not sleeping
+
+  // swap_interval: whether a window's swap interval can be set, not so headless
+  FramePacer(Mode mode, double fps, bool swap_interval);
+
+  Mode mode() const { return mode_; }
+  double fps() const { return fps_; }
+  void setMode(Mode mode);
+  // vsync, adaptive, cap, unlocked and around
+  void nextMode() { setMode((Mode)(((int)mode_ + 1) % 4)); }
+
+  static const char* name(Mode mode);
+  static bool parse(const char* name, Mode& mode);
+
+  // input arrived, for the latency of the frame that shows it
+  void input();
+  // right before the swap, waits for the frame's deadline when capped
+  void wait();
+  // right after the swap
+  void presented();
+
+  Stats takeStats();
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  Mode mode_;
+  double fps_;
+  bool swap_interval_;
+  bool tear_control_;
+  Clock::time_point deadline_;
+  Clock::time_point last_present_;
+  bool presented_ = false;
+  Clock::time_point first_input_;
+  bool input_pending_ = false;
+
+  // Welford's running mean and variance of the frame times
+  Stats stats_;
+  double frame_ms_m2_ = 0.0;
+};
+
+inline FramePacer::FramePacer(Mode mode, double fps, bool swap_interval)
+    : mode_(mode), fps_(fps > 0.0 ? fps : 60.0), swap_interval_(swap_interval),
+      tear_control_(swap_interval && (glfwExtensionSupported("GLX_EXT_swap_control_tear") ||
+                                      glfwExtensionSupported("WGL_EXT_swap_control_tear"))) {
+  setMode(mode);
+}
+
+inline const char* FramePacer::name(Mode mode) {
+  switch (mode) {
+    case Mode::Vsync: return "vsync";
+    case Mode::Adaptive: return "adaptive";
+    case Mode::Cap: return "cap";
+    case Mode::Unlocked: return "unlocked";
+  }
+  return "";
+}
+
+inline bool FramePacer::parse(const char* name, Mode& mode) {
+  for (int i = 0; i < 4; i++) {
+    if (std::strcmp(name, FramePacer::name((Mode)i)) == 0) {
+      mode = (Mode)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void FramePacer::setMode(Mode mode) {
+  mode_ = mode;
+  deadline_ = Clock::now();
+  if (!swap_interval_)
+    return;
+  if (mode == Mode::Adaptive && !tear_control_)
+    std::cout << "No swap_control_tear, adaptive pacing falls back to vsync" << std::endl;
+  switch (mode) {
+    case Mode::Vsync: glfwSwapInterval(1); break;
+    case Mode::Adaptive: glfwSwapInterval(tear_control_ ? -1 : 1); break;
+    case Mode::Cap:
+    case Mode::Unlocked: glfwSwapInterval(0); break;
+  }
+}
+
+inline void FramePacer::input() {
+  if (!input_pending_)
+    first_input_ = Clock::now();
+  input_pending_ = true;
+}
+
+inline void FramePacer::wait() {
+  if (mode_ != Mode::Cap)
+    return;
+  const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps_));
+  auto now = Clock::now();
+  deadline_ += period;
+  if (deadline_ < now - period)
+    deadline_ = now;   // too late to catch up, start over from here
+
+  const auto spin = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(SPIN_MS));
+  if (deadline_ - now > spin)
+    std::this_thread::sleep_for(deadline_ - now - spin);
+  while (Clock::now() < deadline_)
+    std::this_thread::yield();
+}
+
+inline void FramePacer::presented() {
+  const auto now = Clock::now();
+  if (presented_) {
+    const double ms = std::chrono::duration<double, std::milli>(now - last_present_).count();
+    stats_.frames++;
+    const double delta = ms - stats_.frame_ms_avg;
+    stats_.frame_ms_avg += delta / stats_.frames;
+    frame_ms_m2_ += delta * (ms - stats_.frame_ms_avg);
+    stats_.frame_ms_max = std::max(stats_.frame_ms_max, ms);
+  }
+  last_present_ = now;
+  presented_ = true;
+
+  if (input_pending_) {
+    const double ms = std::chrono::duration<double, std::milli>(now - first_input_).count();
+    stats_.inputs++;
+    stats_.input_ms_avg += (ms - stats_.input_ms_avg) / stats_.inputs;
+    stats_.input_ms_max = std::max(stats_.input_ms_max, ms);
+    input_pending_ = false;
+  }
+}
+
+inline FramePacer::Stats FramePacer::takeStats() {
+  Stats stats = stats_;
+  stats.frame_ms_stddev = stats.frames > 1 ? std::sqrt(frame_ms_m2_ / (stats.frames - 1)) : 0.0;
+  stats_ = Stats();
+  frame_ms_m2_ = 0.0;
+  return stats;
+}
+
+#endif
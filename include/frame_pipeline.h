@@ -0,0 +1,173 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// Hands frame packets from a simulation thread to the render thread through a ring
+// of Slots packets, so the simulation of frame N+1 overlaps the GL submission of
+// frame N. A packet is an immutable snapshot once published: the render thread owns
+// it until endRead() and the simulation never writes it meanwhile. The simulation
+// blocks once it is Slots - 1 frames ahead; double buffering overlaps one frame,
+// triple buffering also absorbs the odd slow frame at the cost of a frame of latency.
+// Packets are reused, so the vectors inside them keep their capacity.
+//
+// Every packet is timestamped through the stages, takeStats() averages them.
+template <typename Packet, size_t Slots = 2>
+class FramePipeline {
+  static_assert(Slots >= 2, "a pipeline needs a packet to write while another is read");
+
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  // milliseconds per frame, averaged over the frames read since the last takeStats()
+  struct Stats {
+    size_t frames = 0;
+    double simulate_ms = 0.0;      // beginWrite() to publish()
+    double queued_ms = 0.0;        // publish() to beginRead(), ready but not yet picked up
+    double render_ms = 0.0;        // beginRead() to endRead()
+    double latency_ms = 0.0;       // beginWrite() to endRead(), simulation start to frame done
+    double render_wait_ms = 0.0;   // render thread blocked in beginRead() for want of a packet
+  };
+
+  // simulation thread: the next free packet, waiting for the render thread to release
+  // one; nullptr once stopped
+  Packet* beginWrite();
+  void publish();
+
+  // render thread: the oldest published packet, waiting for the simulation to publish
+  // one; nullptr once stopped
+  const Packet* beginRead();
+  void endRead();
+
+  // wake both threads and refuse further packets
+  void stop();
+  // hand the packets published but not read to unread, oldest first, then accept
+  // packets again; only with no thread inside. Whatever state they carry is lost
+  // unless unread applies it
+  template <typename Unread>
+  void reset(Unread&& unread);
+
+  Stats takeStats();
+
+private:
+  enum class State { Free, Writing, Ready, Reading };
+
+  struct Slot {
+    Packet packet;
+    State state = State::Free;
+    Clock::time_point write_begin, published, read_begin;
+  };
+
+  static double milliseconds(Clock::time_point begin, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+  }
+
+  std::array<Slot, Slots> slots_;
+  size_t write_index_ = 0;   // next slot the simulation fills
+  size_t read_index_ = 0;    // next slot the render thread draws
+  bool stopped_ = false;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  Stats sums_;
+};
+
+template <typename Packet, size_t Slots>
+Packet* FramePipeline<Packet, Slots>::beginWrite() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Slot& slot = slots_[write_index_];
+  changed_.wait(lock, [&] { return stopped_ || slot.state == State::Free; });
+  if (stopped_)
+    return nullptr;
+  slot.state = State::Writing;
+  slot.write_begin = Clock::now();
+  return &slot.packet;
+}
+
+template <typename Packet, size_t Slots>
+void FramePipeline<Packet, Slots>::publish() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot& slot = slots_[write_index_];
+    slot.state = State::Ready;
+    slot.published = Clock::now();
+    write_index_ = (write_index_ + 1) % Slots;
+  }
+  changed_.notify_all();
+}
+
+template <typename Packet, size_t Slots>
+const Packet* FramePipeline<Packet, Slots>::beginRead() {
+  const Clock::time_point wait_begin = Clock::now();
+  std::unique_lock<std::mutex> lock(mutex_);
+  Slot& slot = slots_[read_index_];
+  changed_.wait(lock, [&] { return stopped_ || slot.state == State::Ready; });
+  if (stopped_)
+    return nullptr;
+  slot.state = State::Reading;
+  slot.read_begin = Clock::now();
+  sums_.render_wait_ms += milliseconds(wait_begin, slot.read_begin);
+  return &slot.packet;
+}
+
+template <typename Packet, size_t Slots>
+void FramePipeline<Packet, Slots>::endRead() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot& slot = slots_[read_index_];
+    const Clock::time_point read_end = Clock::now();
+    sums_.frames++;
+    sums_.simulate_ms += milliseconds(slot.write_begin, slot.published);
+    sums_.queued_ms += milliseconds(slot.published, slot.read_begin);
+    sums_.render_ms += milliseconds(slot.read_begin, read_end);
+    sums_.latency_ms += milliseconds(slot.write_begin, read_end);
+    slot.state = State::Free;
+    read_index_ = (read_index_ + 1) % Slots;
+  }
+  changed_.notify_all();
+}
+
+template <typename Packet, size_t Slots>
+void FramePipeline<Packet, Slots>::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  changed_.notify_all();
+}
+
+template <typename Packet, size_t Slots>
+template <typename Unread>
+void FramePipeline<Packet, Slots>::reset(Unread&& unread) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < Slots; i++) {
+    Slot& slot = slots_[(read_index_ + i) % Slots];
+    if (slot.state == State::Ready)
+      unread(static_cast<const Packet&>(slot.packet));
+  }
+  for (Slot& slot : slots_)
+    slot.state = State::Free;
+  write_index_ = read_index_ = 0;
+  stopped_ = false;
+}
+
+template <typename Packet, size_t Slots>
+typename FramePipeline<Packet, Slots>::Stats FramePipeline<Packet, Slots>::takeStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = sums_;
+  sums_ = Stats();
+  if (stats.frames > 0) {
+    stats.simulate_ms /= stats.frames;
+    stats.queued_ms /= stats.frames;
+    stats.render_ms /= stats.frames;
+    stats.latency_ms /= stats.frames;
+    stats.render_wait_ms /= stats.frames;
+  }
+  return stats;
+}
+
+#endif
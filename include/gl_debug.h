@@ -0,0 +1,212 @@
+#ifndef GL_DEBUG_H
+#define GL_DEBUG_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if __has_include(<execinfo.h>) && __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#include <execinfo.h>
+#define GL_DEBUG_STACKS
+#endif
+
+// The KHR_debug messages of the context, once enable() installed the callback;
+// ContextDebug does with --gl-debug, which also asks for a debug context. Output is
+// synchronous, the callback runs inside the GL call that caused the message, so
+// the stack captured there leads back to the sample's code.
+//
+// Messages are classified by their type: errors, performance warnings (shader
+// recompiles, buffers moved between memories, pipeline stalls on readbacks, ...),
+// other warnings (undefined, deprecated or unportable behavior) and information.
+// The same message from the same source counts once with the stack it first came
+// from; the first of each that is not information goes to cerr when it arrives,
+// report() lists them all. Stack frames in the executable are named if it exports
+// its symbols, otherwise addr2line turns the addresses into lines. Like the GL
+// objects, everything belongs to the context's thread.
+class GLDebug {
+public:
+  enum Class { ERROR, PERFORMANCE, WARNING, INFO, CLASSES };
+
+  struct Stats {
+    size_t messages[CLASSES] = {};   // every one received, duplicates included
+    size_t distinct = 0;
+  };
+
+  static constexpr int STACK_DEPTH = 24;
+  static constexpr size_t MAX_DISTINCT = 256;   // further ones are only counted
+
+  // installs the callback on the current context, false if it has no KHR_debug
+  static bool enable();
+  static bool enabled() { return registry_.enabled; }
+
+  // names the object in the driver's messages and in debuggers, when enabled; buffers,
+  // textures, vertex arrays and framebuffers only exist once they were first bound
+  static void label(GLenum identifier, GLuint id, const std::string& name);
+
+  static Stats stats() { return registry_.stats; }
+  static const char* name(Class type);
+
+  // every distinct message that is not information with its count and stack, false if there are none
+  static bool report(std::ostream& out);
+
+private:
+  struct Message {
+    Class type;
+    GLenum source, severity;
+    GLuint id;
+    std::string text;
+    size_t count = 0;
+    std::vector<void*> stack;
+  };
+
+  struct Registry {
+    bool enabled = false;
+    std::vector<Message> messages;
+    std::unordered_map<std::string, size_t> index;   // by source, id and text, NOT_KEPT past MAX_DISTINCT
+    Stats stats;
+  };
+
+  static constexpr size_t NOT_KEPT = SIZE_MAX;
+
+  static Class classify(GLenum type);
+  static const char* severityName(GLenum severity);
+  static void printStack(std::ostream& out, const std::vector<void*>& stack);
+  static void APIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+                                const GLchar* text, const void* user);
+
+  static Registry registry_;
+};
+
+inline GLDebug::Registry GLDebug::registry_;
+
+inline bool GLDebug::enable() {
+  if (!GLEW_KHR_debug && !GLEW_VERSION_4_3)
+    return false;
+  glEnable(GL_DEBUG_OUTPUT);
+  glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  glDebugMessageCallback(callback, nullptr);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+  // the GPU profiler's groups, ours anyway
+  glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+  glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+  registry_.enabled = true;
+  return true;
+}
+
+inline void GLDebug::label(GLenum identifier, GLuint id, const std::string& name) {
+  if (registry_.enabled && id)
+    glObjectLabel(identifier, id, (GLsizei)name.size(), name.c_str());
+}
+
+inline const char* GLDebug::name(Class type) {
+  static const char* const NAMES[CLASSES] = {"error", "performance", "warning", "info"};
+  return NAMES[type];
+}
+
+inline GLDebug::Class GLDebug::classify(GLenum type) {
+  switch (type) {
+    case GL_DEBUG_TYPE_ERROR:
+      return ERROR;
+    case GL_DEBUG_TYPE_PERFORMANCE:
+      return PERFORMANCE;
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: case GL_DEBUG_TYPE_PORTABILITY:
+      return WARNING;
+  }
+  return INFO;
+}
+
+inline const char* GLDebug::severityName(GLenum severity) {
+  switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH: return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+    case GL_DEBUG_SEVERITY_LOW: return "low";
+  }
+  return "notification";
+}
+
+inline void APIENTRY GLDebug::callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+                                       const GLchar* text, const void*) {
+  const Class kind = classify(type);
+  registry_.stats.messages[kind]++;
+  std::string message = length < 0 ? std::string(text) : std::string(text, length);
+  while (!message.empty() && (message.back() == '\n' || message.back() == ' '))
+    message.pop_back();
+
+  const std::string key = std::to_string(source) + ":" + std::to_string(id) + ":" + message;
+  const auto known = registry_.index.find(key);
+  if (known != registry_.index.end()) {
+    if (known->second != NOT_KEPT)
+      registry_.messages[known->second].count++;
+    return;
+  }
+  registry_.stats.distinct++;
+  if (registry_.messages.size() >= MAX_DISTINCT) {
+    // only remembered, so its repeats are not counted as new
+    registry_.index.emplace(key, NOT_KEPT);
+    return;
+  }
+  registry_.index.emplace(key, registry_.messages.size());
+  registry_.messages.push_back(Message{kind, source, severity, id, message, 1, {}});
+  if (kind == INFO)
+    return;
+#ifdef GL_DEBUG_STACKS
+  void* frames[STACK_DEPTH + 1];
+  const int depth = backtrace(frames, STACK_DEPTH + 1);
+  // without the callback itself
+  registry_.messages.back().stack.assign(frames + std::min(depth, 1), frames + depth);
+#endif
+  std::cerr << "GL " << name(kind) << " (" << severityName(severity) << "): " << message << std::endl;
+}
+
+inline void GLDebug::printStack(std::ostream& out, const std::vector<void*>& stack) {
+#ifdef GL_DEBUG_STACKS
+  char** symbols = backtrace_symbols(stack.data(), (int)stack.size());
+  if (!symbols)
+    return;
+  for (size_t i = 0; i < stack.size(); i++) {
+    // module(mangled+0x1f) [0x...], with the mangled name demangled where there is one
+    std::string frame = symbols[i];
+    const size_t open = frame.find('('), plus = frame.find('+', open);
+    if (open != std::string::npos && plus != std::string::npos && plus > open + 1) {
+      int status = 0;
+      char* demangled = abi::__cxa_demangle(frame.substr(open + 1, plus - open - 1).c_str(), nullptr, nullptr, &status);
+      if (status == 0 && demangled)
+        frame.replace(open + 1, plus - open - 1, demangled);
+      std::free(demangled);
+    }
+    out << "      " << frame << std::endl;
+  }
+  std::free(symbols);
+#endif
+}
+
+inline bool GLDebug::report(std::ostream& out) {
+  const Stats& stats = registry_.stats;
+  if (stats.messages[ERROR] + stats.messages[PERFORMANCE] + stats.messages[WARNING] == 0)
+    return false;
+  out << "GL debug: " << stats.messages[ERROR] << " errors, " << stats.messages[PERFORMANCE]
+      << " performance warnings, " << stats.messages[WARNING] << " warnings, " << stats.messages[INFO]
+      << " other messages, " << stats.distinct << " distinct" << std::endl;
+  // errors first, then performance and the other warnings
+  for (int type = ERROR; type < INFO; type++)
+    for (const Message& message : registry_.messages) {
+      if (message.type != type)
+        continue;
+      out << "  " << message.count << "x " << name(message.type) << " (" << severityName(message.severity)
+          << ", id " << message.id << "): " << message.text << std::endl;
+      printStack(out, message.stack);
+    }
+  if (stats.distinct > registry_.messages.size())
+    out << "  " << stats.distinct - registry_.messages.size() << " more distinct messages not kept" << std::endl;
+  return true;
+}
+
+#endif
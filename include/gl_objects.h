@@ -0,0 +1,373 @@
+#ifndef GL_OBJECTS_H
+#define GL_OBJECTS_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "gl_debug.h"
+
+// where a GL object was created, filled in at the caller by the default arguments
+struct GLCallSite {
+  const char* file;
+  int line;
+
+  GLCallSite(const char* file = __builtin_FILE(), int line = __builtin_LINE()) : file(file), line(line) {}
+};
+
+// Every GL object created through the wrappers below, with the memory it was given
+// and where it was created. Bytes are computed from the internal format and size of
+// every level, as requested, not as the driver lays them out: it may pad RGB to
+// RGBA, align rows or keep copies, so they are a lower bound. Programs count no bytes.
+//
+// takeStats() returns what was created and deleted since the last call,
+// ContextStats takes it every frame; report() lists what is alive per kind and
+// reportLeaks() what is still alive grouped by call site, ContextDebug prints it
+// when the sample ends. Like the GL objects, the table belongs to the context's thread.
+class GLObjects {
+public:
+  enum Kind { BUFFER, TEXTURE, VERTEX_ARRAY, PROGRAM, FRAMEBUFFER, KINDS };
+
+  struct Stats {
+    size_t created = 0, deleted = 0;
+    size_t bytes_allocated = 0, bytes_freed = 0;
+  };
+
+  static void created(Kind kind, GLuint id, const GLCallSite& site);
+  static void resized(Kind kind, GLuint id, size_t bytes);
+  static void deleted(Kind kind, GLuint id);
+
+  static size_t count(Kind kind) { return registry_.count[kind]; }
+  static size_t bytes(Kind kind) { return registry_.bytes[kind]; }
+  static size_t count();
+  static size_t bytes();
+  static Stats takeStats();
+
+  static const char* name(Kind kind);
+  // the identifier glObjectLabel takes for the kind
+  static GLenum identifier(Kind kind);
+  // bytes of a pixel in internal_format, 0 for compressed or unknown formats
+  static size_t bytesPerPixel(GLenum internal_format);
+
+  // live objects and bytes per kind
+  static void report(std::ostream& out);
+  // the live objects grouped by call site, false if there are none
+  static bool reportLeaks(std::ostream& out);
+
+private:
+  struct Object {
+    GLCallSite site;
+    size_t bytes = 0;
+  };
+
+  struct Registry {
+    std::unordered_map<uint64_t, Object> objects;   // by kind << 32 | id
+    size_t count[KINDS] = {};
+    size_t bytes[KINDS] = {};
+    Stats stats;
+  };
+
+  static uint64_t key(Kind kind, GLuint id) { return (uint64_t)kind << 32 | id; }
+
+  static Registry registry_;
+};
+
+inline GLObjects::Registry GLObjects::registry_;
+
+// Owns one GL object of a kind, deleting it with the wrapper and keeping the table
+// above up to date. Moves hand the object over, the wrappers cannot be copied.
+template <GLObjects::Kind K>
+class GLObject {
+public:
+  GLObject(const GLObject&) = delete;
+  GLObject& operator=(const GLObject&) = delete;
+
+  GLuint id() const { return id_; }
+  operator GLuint() const { return id_; }
+
+  // the name the driver's debug messages use for the object, see GLDebug::label()
+  void label(const std::string& name) const { GLDebug::label(GLObjects::identifier(K), id_, name); }
+
+protected:
+  GLObject(GLuint id, const GLCallSite& site) : id_(id) { GLObjects::created(K, id_, site); }
+  GLObject(GLObject&& other) : id_(other.id_) { other.id_ = 0; }
+  GLObject& operator=(GLObject&& other) {
+    std::swap(id_, other.id_);
+    return *this;
+  }
+  ~GLObject() {
+    if (id_)
+      GLObjects::deleted(K, id_);
+  }
+
+  GLuint id_;
+};
+
+class GLBuffer : public GLObject<GLObjects::BUFFER> {
+public:
+  explicit GLBuffer(const GLCallSite& site = GLCallSite()) : GLObject(generate(), site) {}
+  GLBuffer(GLBuffer&&) = default;
+  GLBuffer& operator=(GLBuffer&&) = default;
+  ~GLBuffer() { glDeleteBuffers(1, &id_); }
+
+  // glBufferData and glBufferStorage with the buffer bound to target, where it stays
+  void data(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+  void storage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+private:
+  static GLuint generate() {
+    GLuint id = 0;
+    glGenBuffers(1, &id);
+    return id;
+  }
+};
+
+class GLTexture : public GLObject<GLObjects::TEXTURE> {
+public:
+  static constexpr int MAX_LEVELS = 16;
+
+  explicit GLTexture(const GLCallSite& site = GLCallSite()) : GLObject(generate(), site) {}
+  GLTexture(GLTexture&&) = default;
+  GLTexture& operator=(GLTexture&&) = default;
+  ~GLTexture() { glDeleteTextures(1, &id_); }
+
+  // glTexImage2D, glTexStorage2D and glGenerateMipmap on GL_TEXTURE_2D with the texture bound there
+  void image2D(GLint level, GLint internal_format, GLsizei width, GLsizei height, GLenum format, GLenum type,
+               const void* pixels);
+  void storage2D(GLsizei levels, GLenum internal_format, GLsizei width, GLsizei height);
+  void generateMipmap();
+
+private:
+  static GLuint generate() {
+    GLuint id = 0;
+    glGenTextures(1, &id);
+    return id;
+  }
+  void setLevel(int level, GLenum internal_format, GLsizei width, GLsizei height);
+
+  size_t level_bytes_[MAX_LEVELS] = {};
+  GLenum format_ = 0;   // of level 0, for the mipmaps
+  GLsizei width_ = 0, height_ = 0;
+};
+
+class GLVertexArray : public GLObject<GLObjects::VERTEX_ARRAY> {
+public:
+  explicit GLVertexArray(const GLCallSite& site = GLCallSite()) : GLObject(generate(), site) {}
+  GLVertexArray(GLVertexArray&&) = default;
+  GLVertexArray& operator=(GLVertexArray&&) = default;
+  ~GLVertexArray() { glDeleteVertexArrays(1, &id_); }
+
+private:
+  static GLuint generate() {
+    GLuint id = 0;
+    glGenVertexArrays(1, &id);
+    return id;
+  }
+};
+
+class GLProgram : public GLObject<GLObjects::PROGRAM> {
+public:
+  explicit GLProgram(const GLCallSite& site = GLCallSite()) : GLObject(glCreateProgram(), site) {}
+  GLProgram(GLProgram&&) = default;
+  GLProgram& operator=(GLProgram&&) = default;
+  ~GLProgram() { glDeleteProgram(id_); }
+};
+
+class GLFramebuffer : public GLObject<GLObjects::FRAMEBUFFER> {
+public:
+  explicit GLFramebuffer(const GLCallSite& site = GLCallSite()) : GLObject(generate(), site) {}
+  GLFramebuffer(GLFramebuffer&&) = default;
+  GLFramebuffer& operator=(GLFramebuffer&&) = default;
+  ~GLFramebuffer() { glDeleteFramebuffers(1, &id_); }
+
+private:
+  static GLuint generate() {
+    GLuint id = 0;
+    glGenFramebuffers(1, &id);
+    return id;
+  }
+};
+
+inline void GLObjects::created(Kind kind, GLuint id, const GLCallSite& site) {
+  Object& object = registry_.objects[key(kind, id)];
+  object.site = site;
+  object.bytes = 0;
+  registry_.count[kind]++;
+  registry_.stats.created++;
+}
+
+inline void GLObjects::resized(Kind kind, GLuint id, size_t bytes) {
+  const auto object = registry_.objects.find(key(kind, id));
+  if (object == registry_.objects.end())
+    return;
+  if (bytes > object->second.bytes)
+    registry_.stats.bytes_allocated += bytes - object->second.bytes;
+  else
+    registry_.stats.bytes_freed += object->second.bytes - bytes;
+  registry_.bytes[kind] = registry_.bytes[kind] + bytes - object->second.bytes;
+  object->second.bytes = bytes;
+}
+
+inline void GLObjects::deleted(Kind kind, GLuint id) {
+  const auto object = registry_.objects.find(key(kind, id));
+  if (object == registry_.objects.end())
+    return;
+  registry_.count[kind]--;
+  registry_.bytes[kind] -= object->second.bytes;
+  registry_.stats.deleted++;
+  registry_.stats.bytes_freed += object->second.bytes;
+  registry_.objects.erase(object);
+}
+
+inline size_t GLObjects::count() {
+  size_t count = 0;
+  for (int kind = 0; kind < KINDS; kind++)
+    count += registry_.count[kind];
+  return count;
+}
+
+inline size_t GLObjects::bytes() {
+  size_t bytes = 0;
+  for (int kind = 0; kind < KINDS; kind++)
+    bytes += registry_.bytes[kind];
+  return bytes;
+}
+
+inline GLObjects::Stats GLObjects::takeStats() {
+  const Stats stats = registry_.stats;
+  registry_.stats = Stats();
+  return stats;
+}
+
+inline const char* GLObjects::name(Kind kind) {
+  static const char* const NAMES[KINDS] = {"buffer", "texture", "vertex array", "program", "framebuffer"};
+  return NAMES[kind];
+}
+
+inline GLenum GLObjects::identifier(Kind kind) {
+  static const GLenum IDENTIFIERS[KINDS] = {GL_BUFFER, GL_TEXTURE, GL_VERTEX_ARRAY, GL_PROGRAM, GL_FRAMEBUFFER};
+  return IDENTIFIERS[kind];
+}
+
+inline size_t GLObjects::bytesPerPixel(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_RED: case GL_R8: case GL_R8I: case GL_R8UI:
+      return 1;
+    case GL_RG: case GL_RG8: case GL_R16: case GL_R16F: case GL_R16I: case GL_R16UI: case GL_DEPTH_COMPONENT16:
+      return 2;
+    case GL_RGB: case GL_RGB8: case GL_SRGB8: case GL_DEPTH_COMPONENT24:
+      return 3;
+    case GL_RGBA: case GL_RGBA8: case GL_SRGB8_ALPHA8: case GL_RGB10_A2: case GL_R11F_G11F_B10F: case GL_RG16:
+    case GL_RG16F: case GL_R32F: case GL_R32I: case GL_R32UI: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8:
+    case GL_DEPTH_COMPONENT:
+      return 4;
+    case GL_RGB16F:
+      return 6;
+    case GL_RGBA16: case GL_RGBA16F: case GL_RG32F: case GL_RG32I: case GL_RG32UI: case GL_DEPTH32F_STENCIL8:
+      return 8;
+    case GL_RGB32F:
+      return 12;
+    case GL_RGBA32F: case GL_RGBA32I: case GL_RGBA32UI:
+      return 16;
+  }
+  return 0;
+}
+
+inline void GLObjects::report(std::ostream& out) {
+  out << "  " << std::left << std::setw(16) << "GL objects" << std::right << std::setw(8) << "live"
+      << std::setw(12) << "MB" << std::endl;
+  out << std::fixed << std::setprecision(2);
+  for (int kind = 0; kind < KINDS; kind++)
+    out << "  " << std::left << std::setw(16) << name((Kind)kind) << std::right << std::setw(8)
+        << registry_.count[kind] << std::setw(12) << registry_.bytes[kind] / (1024.0 * 1024.0) << std::endl;
+  out << std::defaultfloat << std::setprecision(6);
+}
+
+inline bool GLObjects::reportLeaks(std::ostream& out) {
+  if (registry_.objects.empty())
+    return false;
+  struct Leak {
+    size_t count = 0, bytes = 0;
+  };
+  // by call site and kind, sorted by file and line
+  std::map<std::pair<std::pair<std::string, int>, int>, Leak> leaks;
+  for (const auto& entry : registry_.objects) {
+    const Object& object = entry.second;
+    Leak& leak = leaks[{{object.site.file, object.site.line}, (int)(entry.first >> 32)}];
+    leak.count++;
+    leak.bytes += object.bytes;
+  }
+  out << count() << " GL objects still alive, " << std::fixed << std::setprecision(2)
+      << bytes() / (1024.0 * 1024.0) << " MB:" << std::endl;
+  for (const auto& entry : leaks) {
+    const std::string& file = entry.first.first.first;
+    const size_t slash = file.find_last_of("/\\");
+    out << "  " << std::left << std::setw(14) << name((Kind)entry.first.second) << std::right << std::setw(4)
+        << entry.second.count << "x" << std::setw(10) << entry.second.bytes / (1024.0 * 1024.0) << " MB  "
+        << (slash == std::string::npos ? file : file.substr(slash + 1)) << ":" << entry.first.first.second
+        << std::endl;
+  }
+  out << std::defaultfloat << std::setprecision(6);
+  return true;
+}
+
+inline void GLBuffer::data(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+  glBindBuffer(target, id_);
+  glBufferData(target, size, data, usage);
+  GLObjects::resized(GLObjects::BUFFER, id_, (size_t)size);
+}
+
+inline void GLBuffer::storage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags) {
+  glBindBuffer(target, id_);
+  glBufferStorage(target, size, data, flags);
+  GLObjects::resized(GLObjects::BUFFER, id_, (size_t)size);
+}
+
+inline void GLTexture::setLevel(int level, GLenum internal_format, GLsizei width, GLsizei height) {
+  if (level < 0 || level >= MAX_LEVELS)
+    return;
+  level_bytes_[level] = GLObjects::bytesPerPixel(internal_format) * width * height;
+  if (level == 0) {
+    format_ = internal_format;
+    width_ = width;
+    height_ = height;
+  }
+  size_t bytes = 0;
+  for (size_t level_bytes : level_bytes_)
+    bytes += level_bytes;
+  GLObjects::resized(GLObjects::TEXTURE, id_, bytes);
+}
+
+inline void GLTexture::image2D(GLint level, GLint internal_format, GLsizei width, GLsizei height, GLenum format,
+                               GLenum type, const void* pixels) {
+  glBindTexture(GL_TEXTURE_2D, id_);
+  glTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, format, type, pixels);
+  setLevel(level, internal_format, width, height);
+}
+
+inline void GLTexture::storage2D(GLsizei levels, GLenum internal_format, GLsizei width, GLsizei height) {
+  glBindTexture(GL_TEXTURE_2D, id_);
+  glTexStorage2D(GL_TEXTURE_2D, levels, internal_format, width, height);
+  for (int level = 0; level < levels; level++)
+    setLevel(level, internal_format, std::max(1, width >> level), std::max(1, height >> level));
+}
+
+inline void GLTexture::generateMipmap() {
+  glBindTexture(GL_TEXTURE_2D, id_);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  // every level down to 1x1
+  for (int level = 1; level < MAX_LEVELS && ((width_ >> (level - 1)) > 1 || (height_ >> (level - 1)) > 1); level++)
+    setLevel(level, format_, std::max(1, width_ >> level), std::max(1, height_ >> level));
+}
+
+#endif
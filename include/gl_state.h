@@ -0,0 +1,294 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// Shadow of the GL state the render loops keep setting: program, vertex array, buffer
+// bindings, textures and samplers per unit, blending, depth and culling, viewport.
+// A call that would set what is already set never reaches the driver. The shadow
+// starts out unknown, so the first call of each kind always goes through, and has
+// to be invalidated after code that bypasses it touches the same state.
+//
+// With validation on, every call compares the whole shadow against glGet* and
+// reports the differences, to catch code that changed state behind its back.
+class GLState {
+public:
+  static constexpr int TEXTURE_UNITS = 16;
+
+  // calls made through the cache since the last takeStats(), and how many it dropped
+  struct Stats {
+    size_t calls = 0;
+    size_t filtered = 0;
+  };
+
+  GLState() { invalidate(); }
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  // array, element array, uniform, shader storage and draw indirect buffers are cached
+  void bindBuffer(GLenum target, GLuint buffer);
+  // 2D, 2D array, 3D and cube map textures are cached
+  void bindTexture(GLuint unit, GLenum target, GLuint texture);
+  void bindSampler(GLuint unit, GLuint sampler);
+
+  // blending, depth test and face culling are cached
+  void enable(GLenum capability) { setCapability(capability, true); }
+  void disable(GLenum capability) { setCapability(capability, false); }
+  void blendFunc(GLenum source, GLenum destination);
+  void depthFunc(GLenum function);
+  void depthMask(bool write);
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  // forget everything, the next call of each kind goes to the driver
+  void invalidate();
+
+  void setValidation(bool validate) { validate_ = validate; }
+  // compare the known state with the driver's, false and a report on cerr on any difference
+  bool validate() const;
+
+  Stats takeStats() {
+    const Stats stats = stats_;
+    stats_ = Stats();
+    return stats;
+  }
+
+private:
+  static constexpr GLuint UNKNOWN = 0xffffffff;
+  static constexpr int BUFFER_TARGETS = 5;
+  static constexpr int TEXTURE_TARGETS = 4;
+  static constexpr int CAPABILITIES = 3;
+
+  static int bufferSlot(GLenum target);
+  static int textureSlot(GLenum target);
+  static int capabilitySlot(GLenum capability);
+
+  // counts the call, true if it has to reach the driver
+  bool changes(GLuint& shadow, GLuint value) {
+    stats_.calls++;
+    if (shadow == value) {
+      stats_.filtered++;
+      return false;
+    }
+    shadow = value;
+    return true;
+  }
+  void activeTexture(GLuint unit);
+  void setCapability(GLenum capability, bool enabled);
+  void validateIfEnabled() const {
+    if (validate_)
+      validate();
+  }
+
+  GLuint program_;
+  GLuint vao_;
+  GLuint buffers_[BUFFER_TARGETS];
+  GLuint active_texture_;
+  GLuint textures_[TEXTURE_UNITS][TEXTURE_TARGETS];
+  GLuint samplers_[TEXTURE_UNITS];
+  GLuint capabilities_[CAPABILITIES];
+  GLuint blend_source_, blend_destination_;
+  GLuint depth_func_;
+  GLuint depth_mask_;
+  GLuint viewport_[4];
+
+  bool validate_ = false;
+  Stats stats_;
+};
+
+inline int GLState::bufferSlot(GLenum target) {
+  switch (target) {
+    case GL_ARRAY_BUFFER: return 0;
+    case GL_ELEMENT_ARRAY_BUFFER: return 1;
+    case GL_UNIFORM_BUFFER: return 2;
+    case GL_SHADER_STORAGE_BUFFER: return 3;
+    case GL_DRAW_INDIRECT_BUFFER: return 4;
+    default: return -1;
+  }
+}
+
+inline int GLState::textureSlot(GLenum target) {
+  switch (target) {
+    case GL_TEXTURE_2D: return 0;
+    case GL_TEXTURE_2D_ARRAY: return 1;
+    case GL_TEXTURE_3D: return 2;
+    case GL_TEXTURE_CUBE_MAP: return 3;
+    default: return -1;
+  }
+}
+
+inline int GLState::capabilitySlot(GLenum capability) {
+  switch (capability) {
+    case GL_BLEND: return 0;
+    case GL_DEPTH_TEST: return 1;
+    case GL_CULL_FACE: return 2;
+    default: return -1;
+  }
+}
+
+inline void GLState::useProgram(GLuint program) {
+  if (changes(program_, program))
+    glUseProgram(program);
+  validateIfEnabled();
+}
+
+inline void GLState::bindVertexArray(GLuint vao) {
+  if (changes(vao_, vao)) {
+    glBindVertexArray(vao);
+    // the element array binding belongs to the vertex array
+    buffers_[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+  }
+  validateIfEnabled();
+}
+
+inline void GLState::bindBuffer(GLenum target, GLuint buffer) {
+  const int slot = bufferSlot(target);
+  GLuint untracked = UNKNOWN;
+  if (changes(slot < 0 ? untracked : buffers_[slot], buffer))
+    glBindBuffer(target, buffer);
+  validateIfEnabled();
+}
+
+inline void GLState::activeTexture(GLuint unit) {
+  if (active_texture_ != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    active_texture_ = unit;
+  }
+}
+
+inline void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+  const int slot = textureSlot(target);
+  GLuint untracked = UNKNOWN;
+  if (changes(slot < 0 || unit >= TEXTURE_UNITS ? untracked : textures_[unit][slot], texture)) {
+    activeTexture(unit);
+    glBindTexture(target, texture);
+  }
+  validateIfEnabled();
+}
+
+inline void GLState::bindSampler(GLuint unit, GLuint sampler) {
+  GLuint untracked = UNKNOWN;
+  if (changes(unit >= TEXTURE_UNITS ? untracked : samplers_[unit], sampler))
+    glBindSampler(unit, sampler);
+  validateIfEnabled();
+}
+
+inline void GLState::setCapability(GLenum capability, bool enabled) {
+  const int slot = capabilitySlot(capability);
+  GLuint untracked = UNKNOWN;
+  if (changes(slot < 0 ? untracked : capabilities_[slot], enabled ? 1 : 0)) {
+    if (enabled)
+      glEnable(capability);
+    else
+      glDisable(capability);
+  }
+  validateIfEnabled();
+}
+
+inline void GLState::blendFunc(GLenum source, GLenum destination) {
+  stats_.calls++;
+  if (blend_source_ == source && blend_destination_ == destination) {
+    stats_.filtered++;
+  }
+  else {
+    glBlendFunc(source, destination);
+    blend_source_ = source;
+    blend_destination_ = destination;
+  }
+  validateIfEnabled();
+}
+
+inline void GLState::depthFunc(GLenum function) {
+  if (changes(depth_func_, function))
+    glDepthFunc(function);
+  validateIfEnabled();
+}
+
+inline void GLState::depthMask(bool write) {
+  if (changes(depth_mask_, write ? 1 : 0))
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+  validateIfEnabled();
+}
+
+inline void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  stats_.calls++;
+  const GLuint viewport[4] = {(GLuint)x, (GLuint)y, (GLuint)width, (GLuint)height};
+  if (viewport[0] == viewport_[0] && viewport[1] == viewport_[1] && viewport[2] == viewport_[2] &&
+      viewport[3] == viewport_[3]) {
+    stats_.filtered++;
+  }
+  else {
+    glViewport(x, y, width, height);
+    for (int i = 0; i < 4; i++)
+      viewport_[i] = viewport[i];
+  }
+  validateIfEnabled();
+}
+
+inline void GLState::invalidate() {
+  program_ = vao_ = active_texture_ = UNKNOWN;
+  for (GLuint& buffer : buffers_)
+    buffer = UNKNOWN;
+  for (auto& unit : textures_)
+    for (GLuint& texture : unit)
+      texture = UNKNOWN;
+  for (GLuint& sampler : samplers_)
+    sampler = UNKNOWN;
+  for (GLuint& capability : capabilities_)
+    capability = UNKNOWN;
+  blend_source_ = blend_destination_ = depth_func_ = depth_mask_ = UNKNOWN;
+  for (GLuint& value : viewport_)
+    value = UNKNOWN;
+}
+
+inline bool GLState::validate() const {
+  bool valid = true;
+  auto check = [&valid](const char* name, GLuint shadow, GLint actual) {
+    if (shadow != UNKNOWN && shadow != (GLuint)actual) {
+      std::cerr << "GL state cache: " << name << " is " << actual << ", cached " << shadow << std::endl;
+      valid = false;
+    }
+  };
+  auto get = [](GLenum parameter) {
+    GLint value = 0;
+    glGetIntegerv(parameter, &value);
+    return value;
+  };
+
+  check("program", program_, get(GL_CURRENT_PROGRAM));
+  check("vertex array", vao_, get(GL_VERTEX_ARRAY_BINDING));
+  const GLenum buffer_bindings[BUFFER_TARGETS] = {GL_ARRAY_BUFFER_BINDING, GL_ELEMENT_ARRAY_BUFFER_BINDING,
+                                                  GL_UNIFORM_BUFFER_BINDING, GL_SHADER_STORAGE_BUFFER_BINDING,
+                                                  GL_DRAW_INDIRECT_BUFFER_BINDING};
+  for (int slot = 0; slot < BUFFER_TARGETS; slot++)
+    check("buffer binding", buffers_[slot], get(buffer_bindings[slot]));
+
+  // the texture queries only see the active unit, switching units here would change the state checked
+  const GLint active_unit = get(GL_ACTIVE_TEXTURE) - GL_TEXTURE0;
+  check("active texture unit", active_texture_, active_unit);
+  if (active_unit >= 0 && active_unit < TEXTURE_UNITS) {
+    const GLenum texture_bindings[TEXTURE_TARGETS] = {GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_ARRAY,
+                                                      GL_TEXTURE_BINDING_3D, GL_TEXTURE_BINDING_CUBE_MAP};
+    for (int slot = 0; slot < TEXTURE_TARGETS; slot++)
+      check("texture binding", textures_[active_unit][slot], get(texture_bindings[slot]));
+    check("sampler binding", samplers_[active_unit], get(GL_SAMPLER_BINDING));
+  }
+
+  const GLenum capabilities[CAPABILITIES] = {GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE};
+  for (int slot = 0; slot < CAPABILITIES; slot++)
+    check("capability", capabilities_[slot], glIsEnabled(capabilities[slot]) ? 1 : 0);
+  check("blend source", blend_source_, get(GL_BLEND_SRC_RGB));
+  check("blend destination", blend_destination_, get(GL_BLEND_DST_RGB));
+  check("depth function", depth_func_, get(GL_DEPTH_FUNC));
+  check("depth mask", depth_mask_, get(GL_DEPTH_WRITEMASK));
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  for (int i = 0; i < 4; i++)
+    check("viewport", viewport_[i], viewport[i]);
+  return valid;
+}
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <GL/glew.h>
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "Config.h"
+#include "bounds.h"
+#include "depth_pyramid.h"
+#include "shader.h"
+
+// Frustum culling on the GPU (needs GL 4.3 compute).
+// A compute shader tests the bounds of every instance and appends the survivors to
+// their draw group's slice of the visible buffer, bumping the instance count of the
+// group's indirect draw command with an atomic add. The CPU only dispatches and
+// issues one multi draw, so its cost does not depend on the number of instances.
+// Given a depth pyramid, instances hidden behind the occluders in it are dropped too.
+class GpuCulling {
+public:
+  // an instance as laid out in the std430 instance buffer
+  struct Instance {
+    glm::mat4 model;
+    glm::vec3 bounds_min;  // world space bounds
+    uint32_t group;        // draw group the instance is drawn with
+    glm::vec3 bounds_max;
+    uint32_t padding;
+  };
+
+  // a mesh range in the buffers of the VAO bound at draw()
+  struct DrawGroup {
+    GLuint index_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint max_instances;
+  };
+
+  // layout read by glDrawElementsIndirect
+  struct DrawCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+  };
+
+  struct Stats {
+    GLuint tested = 0;
+    GLuint visible = 0;
+    GLuint occluded = 0;  // inside the frustum but behind the occluders
+  };
+
+  GpuCulling();
+  ~GpuCulling();
+
+  void setDrawGroups(const std::vector<DrawGroup>& groups);
+  // (re)allocate the instance buffer and upload count instances
+  void setInstances(const Instance* instances, GLsizei count);
+  // overwrite instances [first, first + count)
+  void updateInstances(const Instance* instances, GLsizei first, GLsizei count);
+
+  // occluders is optional, its pyramid bound to texture unit 0 while culling
+  void cull(const glm::mat4& view_projection, const DepthPyramid* occluders = nullptr);
+  // draw every group with the VAO currently bound, reading the commands cull() wrote
+  void draw() const;
+
+  // visible model matrices grouped per draw group, bind as per instance vertex attribute
+  GLuint visibleBuffer() const { return visible_buffer_; }
+  // counters of a frame a few frames back, read without stalling
+  const Stats& stats() const { return stats_; }
+
+private:
+  static constexpr int LOCAL_SIZE = 64;
+  static constexpr int READBACK_FRAMES = 3;
+
+  void readbackStats();
+
+  ShaderProgram cull_program_;
+  ShaderProgram compact_program_;
+  GLint planes_loc_, instance_count_loc_, group_count_loc_;
+  GLint occlusion_loc_, occlusion_view_projection_loc_;
+  // instanced draws get their draw count from the GPU (ARB_indirect_parameters)
+  bool gpu_draw_count_;
+
+  GLuint instance_buffer_ = 0;
+  GLuint visible_buffer_ = 0;
+  GLuint command_buffer_ = 0;
+  GLuint reset_buffer_ = 0;        // commands with zero instances copied over each frame
+  GLuint compacted_buffer_ = 0;
+  GLuint draw_count_buffer_ = 0;
+  GLuint stats_buffer_ = 0;
+  GLuint readback_buffers_[READBACK_FRAMES] = {};
+  GLsync readback_fences_[READBACK_FRAMES] = {};
+  GLsizei instance_count_ = 0;
+  GLsizei group_count_ = 0;
+  unsigned int frame_ = 0;
+  Stats stats_;
+};
+
+static_assert(sizeof(GpuCulling::Instance) == 96, "instance must match the std430 layout");
+static_assert(sizeof(GpuCulling::DrawCommand) == 20, "draw command must match the indirect layout");
+
+inline GpuCulling::GpuCulling()
+    : cull_program_(SHADER_DIR "/gpu_culling/cull.comp"),
+      compact_program_(SHADER_DIR "/gpu_culling/compact.comp") {
+  planes_loc_ = glGetUniformLocation(cull_program_.ID, "planes");
+  instance_count_loc_ = glGetUniformLocation(cull_program_.ID, "instanceCount");
+  group_count_loc_ = glGetUniformLocation(compact_program_.ID, "groupCount");
+  occlusion_loc_ = glGetUniformLocation(cull_program_.ID, "occlusion");
+  occlusion_view_projection_loc_ = glGetUniformLocation(cull_program_.ID, "occlusionViewProjection");
+  cull_program_.use();
+  cull_program_.setInt("depthPyramid", 0);
+  gpu_draw_count_ = GLEW_ARB_indirect_parameters;
+
+  glGenBuffers(1, &instance_buffer_);
+  glGenBuffers(1, &visible_buffer_);
+  glGenBuffers(1, &command_buffer_);
+  glGenBuffers(1, &reset_buffer_);
+  glGenBuffers(1, &compacted_buffer_);
+  glGenBuffers(1, &draw_count_buffer_);
+  glGenBuffers(1, &stats_buffer_);
+  glGenBuffers(READBACK_FRAMES, readback_buffers_);
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_count_buffer_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Stats), NULL, GL_DYNAMIC_COPY);
+  for (GLuint buffer : readback_buffers_) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(Stats), NULL, GL_STREAM_READ);
+  }
+}
+
+inline GpuCulling::~GpuCulling() {
+  for (GLsync fence : readback_fences_)
+    if (fence)
+      glDeleteSync(fence);
+  glDeleteBuffers(READBACK_FRAMES, readback_buffers_);
+  glDeleteBuffers(1, &stats_buffer_);
+  glDeleteBuffers(1, &draw_count_buffer_);
+  glDeleteBuffers(1, &compacted_buffer_);
+  glDeleteBuffers(1, &reset_buffer_);
+  glDeleteBuffers(1, &command_buffer_);
+  glDeleteBuffers(1, &visible_buffer_);
+  glDeleteBuffers(1, &instance_buffer_);
+}
+
+inline void GpuCulling::setDrawGroups(const std::vector<DrawGroup>& groups) {
+  // each group owns a slice of the visible buffer large enough for all its instances
+  std::vector<DrawCommand> commands;
+  GLuint base_instance = 0;
+  for (const DrawGroup& group : groups) {
+    commands.push_back(DrawCommand{group.index_count, 0, group.first_index, group.base_vertex, base_instance});
+    base_instance += group.max_instances;
+  }
+  group_count_ = (GLsizei)groups.size();
+
+  const GLsizeiptr commands_size = commands.size() * sizeof(DrawCommand);
+  glBindBuffer(GL_COPY_READ_BUFFER, reset_buffer_);
+  glBufferData(GL_COPY_READ_BUFFER, commands_size, commands.data(), GL_STATIC_COPY);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, command_buffer_);
+  glBufferData(GL_COPY_WRITE_BUFFER, commands_size, commands.data(), GL_DYNAMIC_COPY);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, compacted_buffer_);
+  glBufferData(GL_COPY_WRITE_BUFFER, commands_size, NULL, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, visible_buffer_);
+  glBufferData(GL_COPY_WRITE_BUFFER, base_instance * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+}
+
+inline void GpuCulling::setInstances(const Instance* instances, GLsizei count) {
+  instance_count_ = count;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(Instance), instances, GL_DYNAMIC_DRAW);
+}
+
+inline void GpuCulling::updateInstances(const Instance* instances, GLsizei first, GLsizei count) {
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer_);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(Instance), count * sizeof(Instance), instances);
+}
+
+inline void GpuCulling::cull(const glm::mat4& view_projection, const DepthPyramid* occluders) {
+  readbackStats();
+
+  // start from empty draws and zeroed counters
+  glBindBuffer(GL_COPY_READ_BUFFER, reset_buffer_);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, command_buffer_);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, group_count_ * sizeof(DrawCommand));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer_);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+  const Frustum frustum = Frustum::fromMatrix(view_projection);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instance_buffer_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visible_buffer_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, command_buffer_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, stats_buffer_);
+  cull_program_.use();
+  glUniform4fv(planes_loc_, 6, &frustum.planes[0].x);
+  glUniform1ui(instance_count_loc_, instance_count_);
+  glUniform1i(occlusion_loc_, occluders != nullptr);
+  if (occluders) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, occluders->texture());
+    glUniformMatrix4fv(occlusion_view_projection_loc_, 1, GL_FALSE, &occluders->viewProjection()[0][0]);
+  }
+  glDispatchCompute((instance_count_ + LOCAL_SIZE - 1) / LOCAL_SIZE, 1, 1);
+
+  if (gpu_draw_count_) {
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, compacted_buffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, draw_count_buffer_);
+    compact_program_.use();
+    glUniform1ui(group_count_loc_, group_count_);
+    glDispatchCompute(1, 1, 1);
+  }
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  // queue the counters for readback once the GPU got there
+  const int slot = frame_++ % READBACK_FRAMES;
+  glBindBuffer(GL_COPY_READ_BUFFER, stats_buffer_);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffers_[slot]);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(Stats));
+  readback_fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+inline void GpuCulling::draw() const {
+  if (gpu_draw_count_) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, compacted_buffer_);
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, draw_count_buffer_);
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, group_count_, 0);
+  }
+  else {
+    // empty commands are skipped by the GPU, they only cost a command read
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, group_count_, 0);
+  }
+}
+
+inline void GpuCulling::readbackStats() {
+  // the slot about to be reused was written READBACK_FRAMES frames ago, by now its
+  // fence has almost always signaled; if not, its counters are dropped rather than
+  // waited for and the last ones stay
+  const int slot = frame_ % READBACK_FRAMES;
+  GLsync& fence = readback_fences_[slot];
+  if (!fence)
+    return;
+  GLint status = GL_UNSIGNALED;
+  glGetSynciv(fence, GL_SYNC_STATUS, 1, NULL, &status);
+  glDeleteSync(fence);
+  fence = 0;
+  if (status != GL_SIGNALED)
+    return;
+  glBindBuffer(GL_COPY_READ_BUFFER, readback_buffers_[slot]);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(Stats), &stats_);
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// GPU time of named scopes, passes or single draws, nested as deep as need be. Each
+// scope end is a GL_TIMESTAMP query written with glQueryCounter, which unlike
+// GL_TIME_ELAPSED nests and leaves the one elapsed query GL allows to others. Queries
+// come from a pool per frame in flight and a frame is read back FRAMES_IN_FLIGHT
+// frames later, when the GPU is long done with it; if it is not, its timings are
+// dropped rather than waited for. Every scope keeps min/avg/max over its last
+// HISTORY frames, a scope entered several times in a frame counts the sum.
+//
+// With KHR_debug each scope is also a debug group of the same name, so captures in
+// RenderDoc, Nsight or apitrace show the same tree.
+class GpuProfiler {
+public:
+  static constexpr int FRAMES_IN_FLIGHT = 4;
+  static constexpr int HISTORY = 64;
+
+  struct Timing {
+    std::string name;
+    int depth;   // 0 for the frame, 1 for the scopes right inside it, ...
+    double min_ms, avg_ms, max_ms;
+  };
+
+  // begin() and end() around a block
+  class Scope {
+  public:
+    Scope(GpuProfiler& profiler, const char* name) : profiler_(profiler) { profiler_.begin(name); }
+    ~Scope() { profiler_.end(); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    GpuProfiler& profiler_;
+  };
+
+  // needs the context current, as does everything else
+  GpuProfiler() : debug_groups_(GLEW_KHR_debug) {}
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  // the frame is the outermost scope, beginFrame() also reads back the oldest frame in flight
+  void beginFrame();
+  void endFrame();
+
+  // scopes are told apart by name and enclosing scope, name has to outlive the frame
+  void begin(const char* name);
+  void end();
+
+  // every scope seen so far, each followed by the ones inside it
+  std::vector<Timing> timings() const;
+  // frames whose queries were not done when their turn to be read back came
+  size_t droppedFrames() const { return dropped_; }
+  // timings() as an indented table
+  void report(std::ostream& out) const;
+
+private:
+  struct Marker {
+    int scope;
+    size_t begin, end;   // indices into the frame's queries
+  };
+
+  struct Frame {
+    std::vector<GLuint> queries;
+    size_t used = 0;
+    std::vector<Marker> markers;
+  };
+
+  struct ScopeHistory {
+    std::string name;
+    int parent;
+    int depth;
+    float ms[HISTORY];
+    int count = 0;   // samples in ms, up to HISTORY
+    int next = 0;    // where the next one goes
+  };
+
+  size_t timestamp();
+  int findScope(const char* name, int parent);
+  void readBack(Frame& frame);
+
+  Frame frames_[FRAMES_IN_FLIGHT];
+  std::vector<ScopeHistory> scopes_;
+  std::vector<size_t> open_;     // markers of the current frame begun and not ended, innermost last
+  std::vector<double> frame_ms_;   // per scope, while a frame is read back
+  uint64_t frame_ = 0;
+  size_t dropped_ = 0;
+  bool debug_groups_;
+};
+
+inline GpuProfiler::~GpuProfiler() {
+  for (Frame& frame : frames_)
+    if (!frame.queries.empty())
+      glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+}
+
+inline size_t GpuProfiler::timestamp() {
+  Frame& frame = frames_[frame_ % FRAMES_IN_FLIGHT];
+  if (frame.used == frame.queries.size()) {
+    // the pool only grows, after the first frames it has what a frame needs
+    const size_t added = std::max<size_t>(frame.queries.size(), 16);
+    frame.queries.resize(frame.queries.size() + added);
+    glGenQueries((GLsizei)added, frame.queries.data() + frame.used);
+  }
+  glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+  return frame.used++;
+}
+
+inline int GpuProfiler::findScope(const char* name, int parent) {
+  for (size_t i = 0; i < scopes_.size(); i++)
+    if (scopes_[i].parent == parent && scopes_[i].name == name)
+      return (int)i;
+  ScopeHistory scope;
+  scope.name = name;
+  scope.parent = parent;
+  scope.depth = parent < 0 ? 0 : scopes_[parent].depth + 1;
+  scopes_.push_back(scope);
+  return (int)scopes_.size() - 1;
+}
+
+inline void GpuProfiler::begin(const char* name) {
+  Frame& frame = frames_[frame_ % FRAMES_IN_FLIGHT];
+  const int parent = open_.empty() ? -1 : frame.markers[open_.back()].scope;
+  if (debug_groups_)
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+  frame.markers.push_back(Marker{findScope(name, parent), timestamp(), 0});
+  open_.push_back(frame.markers.size() - 1);
+}
+
+inline void GpuProfiler::end() {
+  if (open_.empty())
+    return;
+  Frame& frame = frames_[frame_ % FRAMES_IN_FLIGHT];
+  frame.markers[open_.back()].end = timestamp();
+  open_.pop_back();
+  if (debug_groups_)
+    glPopDebugGroup();
+}
+
+inline void GpuProfiler::beginFrame() {
+  Frame& frame = frames_[frame_ % FRAMES_IN_FLIGHT];
+  if (!frame.markers.empty())
+    readBack(frame);
+  frame.used = 0;
+  frame.markers.clear();
+  open_.clear();
+  begin("frame");
+}
+
+inline void GpuProfiler::endFrame() {
+  while (!open_.empty())
+    end();
+  frame_++;
+}
+
+inline void GpuProfiler::readBack(Frame& frame) {
+  // timestamps are written in order, the last one done means all are
+  GLint available = 0;
+  glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    dropped_++;
+    return;
+  }
+
+  frame_ms_.assign(scopes_.size(), -1.0);
+  for (const Marker& marker : frame.markers) {
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(frame.queries[marker.begin], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(frame.queries[marker.end], GL_QUERY_RESULT, &end);
+    double& ms = frame_ms_[marker.scope];
+    ms = std::max(ms, 0.0) + (end - begin) * 1e-6;
+  }
+  for (size_t i = 0; i < scopes_.size(); i++) {
+    if (frame_ms_[i] < 0.0)
+      continue;
+    ScopeHistory& scope = scopes_[i];
+    scope.ms[scope.next] = (float)frame_ms_[i];
+    scope.next = (scope.next + 1) % HISTORY;
+    scope.count = std::min(scope.count + 1, HISTORY);
+  }
+}
+
+inline std::vector<GpuProfiler::Timing> GpuProfiler::timings() const {
+  std::vector<Timing> timings;
+  // depth first, children in the order they were first seen
+  auto add = [&](int parent, auto& add) -> void {
+    for (size_t i = 0; i < scopes_.size(); i++) {
+      const ScopeHistory& scope = scopes_[i];
+      if (scope.parent != parent || scope.count == 0)
+        continue;
+      Timing timing{scope.name, scope.depth, scope.ms[0], 0.0, scope.ms[0]};
+      for (int j = 0; j < scope.count; j++) {
+        timing.min_ms = std::min(timing.min_ms, (double)scope.ms[j]);
+        timing.max_ms = std::max(timing.max_ms, (double)scope.ms[j]);
+        timing.avg_ms += scope.ms[j];
+      }
+      timing.avg_ms /= scope.count;
+      timings.push_back(timing);
+      add((int)i, add);
+    }
+  };
+  add(-1, add);
+  return timings;
+}
+
+inline void GpuProfiler::report(std::ostream& out) const {
+  out << "  " << std::left << std::setw(30) << "GPU ms" << std::right << std::setw(9) << "min" << std::setw(9) << "avg"
+      << std::setw(9) << "max" << std::endl;
+  out << std::fixed << std::setprecision(3);
+  for (const Timing& timing : timings()) {
+    const int indent = 2 * timing.depth;
+    out << "  " << std::string(indent, ' ') << std::left << std::setw(30 - indent) << timing.name << std::right
+        << std::setw(9) << timing.min_ms << std::setw(9) << timing.avg_ms << std::setw(9) << timing.max_ms
+        << std::endl;
+  }
+  out << std::defaultfloat << std::setprecision(6);
+  if (dropped_)
+    out << "  " << dropped_ << " frames dropped, their queries were not done in time" << std::endl;
+}
+
+#endif
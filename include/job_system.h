@@ -0,0 +1,88 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing job system. Every worker thread, and the thread that created the
+// system, owns a Chase-Lev deque: it pushes and pops jobs at the bottom while idle
+// workers steal from the top of the others. Jobs form dependency graphs, a job
+// starting once all the jobs it depends on finished (continuations rather than
+// fibers, a job always runs to completion). Jobs marked main thread only, such
+// as GL calls, wait in a separate queue run by the creating thread.
+class JobSystem {
+public:
+  class Job;
+  typedef std::shared_ptr<Job> JobHandle;
+
+  enum class Affinity { Any, MainThread };
+
+  // worker_count 0 uses one worker per hardware thread besides the calling one,
+  // workers are pinned to their own core when pin_threads is set
+  explicit JobSystem(unsigned worker_count = 0, bool pin_threads = true);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  // a job that runs once submitted and all its dependencies finished
+  JobHandle create(std::function<void()> function, Affinity affinity = Affinity::Any);
+  // job waits for dependency, only allowed before job is submitted
+  void addDependency(const JobHandle& job, const JobHandle& dependency);
+  void submit(const JobHandle& job);
+
+  // create, depend and submit in one go
+  JobHandle run(std::function<void()> function, const std::vector<JobHandle>& dependencies = {},
+                Affinity affinity = Affinity::Any);
+
+  // block until job finished, running other jobs meanwhile
+  void wait(const JobHandle& job);
+  bool finished(const JobHandle& job) const;
+
+  // body(begin, end) over [0, count) split into ranges of grain items, 0 sizes them
+  // automatically to a few ranges per thread; returns once all ranges are done
+  void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body, size_t grain = 0);
+
+  // run the main thread queue, call regularly from the thread that created the system
+  size_t runMainThreadJobs();
+
+  unsigned workerCount() const { return (unsigned)workers_.size(); }
+  // workers plus the main thread
+  unsigned threadCount() const { return workerCount() + 1; }
+
+private:
+  class Deque;
+
+  void schedule(Job* job);
+  void execute(Job* job);
+  Job* findJob(unsigned thread_index);
+  bool runOneJob(unsigned thread_index);
+  void workerLoop(unsigned thread_index, bool pin_thread);
+  unsigned currentThreadIndex() const;
+
+  std::vector<std::unique_ptr<Deque>> deques_;   // index 0 belongs to the main thread
+  std::vector<std::thread> workers_;
+
+  std::mutex main_mutex_;
+  std::deque<Job*> main_queue_;
+
+  // jobs pushed by threads outside the system
+  std::mutex injected_mutex_;
+  std::deque<Job*> injected_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::atomic<int64_t> queued_{0};
+  std::atomic<int> sleeping_{0};
+  std::atomic<bool> running_{true};
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "mesh.h"
+#include "mesh_simplify.h"
+
+// levels of detail of a mesh, level 0 the mesh itself and each following one coarser
+struct LodChain {
+  std::vector<Mesh> levels;
+  std::vector<float> errors;  // object space error of each level
+
+  size_t size() const { return levels.size(); }
+};
+
+// simplify mesh down to reduction of the previous level's triangles per level, stopping once a
+// level no longer shrinks (the simplifier ran out of collapses) or max_levels is reached;
+// every level is simplified from the full mesh so the errors do not pile up
+inline LodChain buildLodChain(const Mesh& mesh, int max_levels = 8, float reduction = 0.5f,
+                              float uv_weight = 1.0f) {
+  LodChain chain;
+  chain.levels.push_back(mesh);
+  chain.errors.push_back(0.0f);
+  while ((int)chain.size() < max_levels) {
+    const size_t triangles = chain.levels.back().triangleCount();
+    float error;
+    Mesh level = simplifyMesh(mesh, (size_t)(triangles * reduction), uv_weight, &error);
+    if (level.triangleCount() > triangles * (1.0f + reduction) / 2.0f)
+      break;
+    chain.levels.push_back(std::move(level));
+    chain.errors.push_back(std::max(error, chain.errors.back()));
+  }
+  return chain;
+}
+
+// pixels an object space length at distance from the camera covers on screen
+inline float pixelsPerUnit(const glm::mat4& projection, float viewport_height, float distance) {
+  // projection[1][1] = 1 / tan(fovy / 2) for perspective projections
+  return 0.5f * viewport_height * projection[1][1] / std::max(distance, 1e-4f);
+}
+
+// Coarsest level whose error stays under threshold pixels on screen. Switching to a coarser
+// level than current needs its error to stay under threshold * (1 - hysteresis) instead, so
+// objects sitting at a boundary do not pop back and forth.
+inline int selectLod(const LodChain& chain, int current, float pixels_per_unit, float threshold = 1.0f,
+                     float hysteresis = 0.25f) {
+  for (int level = (int)chain.size() - 1; level > 0; level--) {
+    const float limit = level > current ? threshold * (1.0f - hysteresis) : threshold;
+    if (chain.errors[level] * pixels_per_unit <= limit)
+      return level;
+  }
+  return 0;
+}
+
+#endif
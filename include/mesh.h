@@ -0,0 +1,118 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// vertex layout of the samples: position then texture coordinates, 5 floats
+struct Vertex {
+  glm::vec3 position;
+  glm::vec2 uv;
+};
+
+static_assert(sizeof(Vertex) == 5 * sizeof(float), "vertex must match the 5 float attribute layout");
+
+// indexed triangle list
+struct Mesh {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+
+  size_t triangleCount() const { return indices.size() / 3; }
+};
+
+// weld the identical vertices of an unindexed triangle list, vertices keep the order they first appear in
+inline Mesh indexMesh(const Vertex* vertices, size_t count) {
+  struct Hash {
+    size_t operator()(const Vertex& vertex) const {
+      // FNV-1a over the bytes, identical vertices are bitwise identical
+      const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+      size_t hash = 14695981039346656037ull;
+      for (size_t i = 0; i < sizeof(Vertex); i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+      return hash;
+    }
+  };
+  struct Equal {
+    bool operator()(const Vertex& a, const Vertex& b) const { return std::memcmp(&a, &b, sizeof(Vertex)) == 0; }
+  };
+
+  Mesh mesh;
+  std::unordered_map<Vertex, uint32_t, Hash, Equal> ids;
+  mesh.indices.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    const auto inserted = ids.emplace(vertices[i], (uint32_t)mesh.vertices.size());
+    if (inserted.second)
+      mesh.vertices.push_back(vertices[i]);
+    mesh.indices.push_back(inserted.first->second);
+  }
+  return mesh;
+}
+
+// unit cube centered at the origin, every face with its own four vertices and texture
+inline Mesh createCube() {
+  // corners of each face counter clockwise seen from outside, with their texture coordinates
+  const float faces[6][4][5] = {
+    {{ 0.5f, -0.5f, -0.5f,  0.0f, 0.0f}, {-0.5f, -0.5f, -0.5f,  1.0f, 0.0f},
+     {-0.5f,  0.5f, -0.5f,  1.0f, 1.0f}, { 0.5f,  0.5f, -0.5f,  0.0f, 1.0f}},  // back
+    {{-0.5f, -0.5f,  0.5f,  0.0f, 0.0f}, { 0.5f, -0.5f,  0.5f,  1.0f, 0.0f},
+     { 0.5f,  0.5f,  0.5f,  1.0f, 1.0f}, {-0.5f,  0.5f,  0.5f,  0.0f, 1.0f}},  // front
+    {{-0.5f, -0.5f, -0.5f,  0.0f, 0.0f}, {-0.5f, -0.5f,  0.5f,  1.0f, 0.0f},
+     {-0.5f,  0.5f,  0.5f,  1.0f, 1.0f}, {-0.5f,  0.5f, -0.5f,  0.0f, 1.0f}},  // left
+    {{ 0.5f, -0.5f,  0.5f,  0.0f, 0.0f}, { 0.5f, -0.5f, -0.5f,  1.0f, 0.0f},
+     { 0.5f,  0.5f, -0.5f,  1.0f, 1.0f}, { 0.5f,  0.5f,  0.5f,  0.0f, 1.0f}},  // right
+    {{-0.5f, -0.5f, -0.5f,  0.0f, 0.0f}, { 0.5f, -0.5f, -0.5f,  1.0f, 0.0f},
+     { 0.5f, -0.5f,  0.5f,  1.0f, 1.0f}, {-0.5f, -0.5f,  0.5f,  0.0f, 1.0f}},  // bottom
+    {{-0.5f,  0.5f,  0.5f,  0.0f, 0.0f}, { 0.5f,  0.5f,  0.5f,  1.0f, 0.0f},
+     { 0.5f,  0.5f, -0.5f,  1.0f, 1.0f}, {-0.5f,  0.5f, -0.5f,  0.0f, 1.0f}}   // top
+  };
+
+  Mesh mesh;
+  for (const auto& face : faces) {
+    const uint32_t first = (uint32_t)mesh.vertices.size();
+    for (const auto& corner : face)
+      mesh.vertices.push_back(Vertex{glm::vec3(corner[0], corner[1], corner[2]), glm::vec2(corner[3], corner[4])});
+    for (uint32_t index : {0u, 1u, 2u, 2u, 3u, 0u})
+      mesh.indices.push_back(first + index);
+  }
+  return mesh;
+}
+
+// sphere of radius 0.5 around the origin, u around the equator and v from pole to pole;
+// the u = 0/1 seam and the poles have a vertex per texture coordinate
+inline Mesh createSphere(int rings, int sectors) {
+  Mesh mesh;
+  for (int ring = 0; ring <= rings; ring++) {
+    const float v = (float)ring / rings;
+    const float theta = v * 3.14159265f;
+    // exactly zero at the poles, so the vertices there share a position
+    const float radius = ring == 0 || ring == rings ? 0.0f : std::sin(theta);
+    for (int sector = 0; sector <= sectors; sector++) {
+      const float u = (float)sector / sectors;
+      // the seam vertices repeat the positions of the first column exactly
+      const float phi = (float)(sector % sectors) / sectors * 6.28318531f;
+      const glm::vec3 position(radius * std::cos(phi), -std::cos(theta), -radius * std::sin(phi));
+      mesh.vertices.push_back(Vertex{0.5f * position, glm::vec2(u, v)});
+    }
+  }
+
+  const uint32_t row = sectors + 1;
+  for (int ring = 0; ring < rings; ring++) {
+    for (int sector = 0; sector < sectors; sector++) {
+      const uint32_t a = ring * row + sector;
+      const uint32_t b = a + row;
+      // the triangles touching a pole in a single point are dropped
+      if (ring != 0)
+        mesh.indices.insert(mesh.indices.end(), {a, a + 1, b + 1});
+      if (ring != rings - 1)
+        mesh.indices.insert(mesh.indices.end(), {b + 1, b, a});
+    }
+  }
+  return mesh;
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "mesh.h"
+
+// Quadric error metric over position and texture coordinates (Garland and Heckbert,
+// "Simplifying surfaces with color and texture using quadric error metrics").
+// Each triangle is a plane in the 5D space (x, y, z, u, v), the quadric of a vertex sums
+// the squared distances to the planes of its triangles weighted by their area.
+struct Quadric {
+  static constexpr int N = 5;
+
+  double a[N][N] = {};
+  double b[N] = {};
+  double c = 0.0;
+  double weight = 0.0;  // summed triangle area
+
+  // quadric of the plane through p0, p1, p2, weighted by area
+  static Quadric fromTriangle(const double* p0, const double* p1, const double* p2, double area);
+
+  void add(const Quadric& q);
+  // weighted mean squared distance of point to the planes
+  double error(const double* point) const;
+};
+
+inline Quadric Quadric::fromTriangle(const double* p0, const double* p1, const double* p2, double area) {
+  // orthonormal basis e1, e2 of the triangle's plane
+  double e1[N], e2[N];
+  double e1_length = 0.0;
+  for (int i = 0; i < N; i++) {
+    e1[i] = p1[i] - p0[i];
+    e1_length += e1[i] * e1[i];
+  }
+  e1_length = std::sqrt(e1_length);
+  double along = 0.0;
+  for (int i = 0; i < N; i++) {
+    e1[i] /= e1_length;
+    along += (p2[i] - p0[i]) * e1[i];
+  }
+  double e2_length = 0.0;
+  for (int i = 0; i < N; i++) {
+    e2[i] = p2[i] - p0[i] - along * e1[i];
+    e2_length += e2[i] * e2[i];
+  }
+  e2_length = std::sqrt(e2_length);
+  Quadric q;
+  if (!(e1_length > 0.0 && e2_length > 0.0))
+    return q;
+
+  double p0_e1 = 0.0, p0_e2 = 0.0, p0_p0 = 0.0;
+  for (int i = 0; i < N; i++) {
+    e2[i] /= e2_length;
+    p0_e1 += p0[i] * e1[i];
+    p0_e2 += p0[i] * e2[i];
+    p0_p0 += p0[i] * p0[i];
+  }
+
+  // A = I - e1 e1^T - e2 e2^T, b = (p0.e1) e1 + (p0.e2) e2 - p0, c = p0.p0 - (p0.e1)^2 - (p0.e2)^2
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++)
+      q.a[i][j] = area * ((i == j ? 1.0 : 0.0) - e1[i] * e1[j] - e2[i] * e2[j]);
+    q.b[i] = area * (p0_e1 * e1[i] + p0_e2 * e2[i] - p0[i]);
+  }
+  q.c = area * (p0_p0 - p0_e1 * p0_e1 - p0_e2 * p0_e2);
+  q.weight = area;
+  return q;
+}
+
+inline void Quadric::add(const Quadric& q) {
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++)
+      a[i][j] += q.a[i][j];
+    b[i] += q.b[i];
+  }
+  c += q.c;
+  weight += q.weight;
+}
+
+inline double Quadric::error(const double* point) const {
+  if (weight <= 0.0)
+    return 0.0;
+  double e = c;
+  for (int i = 0; i < N; i++) {
+    double row = 0.0;
+    for (int j = 0; j < N; j++)
+      row += a[i][j] * point[j];
+    e += point[i] * (row + 2.0 * b[i]);
+  }
+  return std::max(e, 0.0) / weight;
+}
+
+// Simplify by collapsing vertices into one of their neighbours (half edge collapse), the
+// cheapest collapse first, until at most target_triangles remain. Collapsed vertices keep
+// the position and texture coordinates of the vertex they merge into, so no attribute is
+// ever interpolated. Vertices on a border or on a texture seam (same position, other uv)
+// never move, keeping the mesh closed and the texture seams intact.
+// uv_weight scales texture coordinates against positions in the error, error receives
+// the largest error of the collapses done, roughly a distance in object space.
+inline Mesh simplifyMesh(const Mesh& mesh, size_t target_triangles, float uv_weight = 1.0f,
+                         float* error = nullptr) {
+  const uint32_t vertex_count = (uint32_t)mesh.vertices.size();
+  const size_t triangle_count = mesh.triangleCount();
+
+  std::vector<double> points(vertex_count * Quadric::N);
+  for (uint32_t v = 0; v < vertex_count; v++) {
+    const Vertex& vertex = mesh.vertices[v];
+    double* point = &points[v * Quadric::N];
+    point[0] = vertex.position.x;
+    point[1] = vertex.position.y;
+    point[2] = vertex.position.z;
+    point[3] = uv_weight * vertex.uv.x;
+    point[4] = uv_weight * vertex.uv.y;
+  }
+
+  // vertices sharing a position, to find seams and borders on the surface rather than in the index buffer
+  std::vector<uint32_t> position_id(vertex_count);
+  {
+    std::map<std::pair<std::pair<float, float>, float>, uint32_t> ids;
+    for (uint32_t v = 0; v < vertex_count; v++) {
+      const glm::vec3& p = mesh.vertices[v].position;
+      position_id[v] = ids.emplace(std::make_pair(std::make_pair(p.x, p.y), p.z), v).first->second;
+    }
+  }
+
+  std::vector<uint32_t> triangles(mesh.indices);
+  std::vector<bool> triangle_alive(triangle_count, true);
+  std::vector<std::vector<uint32_t>> vertex_triangles(vertex_count);
+  std::vector<Quadric> quadrics(vertex_count);
+  std::vector<bool> locked(vertex_count, false);
+  std::map<std::pair<uint32_t, uint32_t>, int> edge_uses;
+  for (size_t t = 0; t < triangle_count; t++) {
+    const uint32_t* tri = &triangles[3 * t];
+    const glm::vec3 normal = glm::cross(mesh.vertices[tri[1]].position - mesh.vertices[tri[0]].position,
+                                        mesh.vertices[tri[2]].position - mesh.vertices[tri[0]].position);
+    const Quadric q = Quadric::fromTriangle(&points[tri[0] * Quadric::N], &points[tri[1] * Quadric::N],
+                                            &points[tri[2] * Quadric::N], 0.5 * glm::length(normal));
+    for (int k = 0; k < 3; k++) {
+      quadrics[tri[k]].add(q);
+      vertex_triangles[tri[k]].push_back((uint32_t)t);
+      const uint32_t a = position_id[tri[k]], b = position_id[tri[(k + 1) % 3]];
+      edge_uses[std::make_pair(std::min(a, b), std::max(a, b))]++;
+    }
+  }
+  for (uint32_t v = 0; v < vertex_count; v++)
+    if (position_id[v] != v)
+      locked[v] = locked[position_id[v]] = true;
+  for (size_t t = 0; t < triangle_count; t++) {
+    for (int k = 0; k < 3; k++) {
+      const uint32_t a = triangles[3 * t + k], b = triangles[3 * t + (k + 1) % 3];
+      const uint32_t pa = position_id[a], pb = position_id[b];
+      if (edge_uses[std::make_pair(std::min(pa, pb), std::max(pa, pb))] != 2)
+        locked[a] = locked[b] = true;
+    }
+  }
+
+  // candidate collapses, stale entries are recognized by the version of their target
+  struct Collapse {
+    double error;
+    uint32_t from, to;
+    uint32_t version;
+    bool operator<(const Collapse& other) const { return error > other.error; }
+  };
+  std::priority_queue<Collapse> queue;
+  std::vector<uint32_t> version(vertex_count, 0);
+  std::vector<bool> alive(vertex_count, true);
+
+  auto push = [&](uint32_t from, uint32_t to) {
+    if (locked[from] || from == to)
+      return;
+    Quadric q = quadrics[from];
+    q.add(quadrics[to]);
+    queue.push(Collapse{q.error(&points[to * Quadric::N]), from, to, version[to]});
+  };
+  for (size_t t = 0; t < triangle_count; t++)
+    for (int k = 0; k < 3; k++) {
+      push(triangles[3 * t + k], triangles[3 * t + (k + 1) % 3]);
+      push(triangles[3 * t + (k + 1) % 3], triangles[3 * t + k]);
+    }
+
+  std::vector<uint32_t> from_neighbours, to_neighbours;
+  auto gatherNeighbours = [&](uint32_t v, std::vector<uint32_t>& neighbours) {
+    neighbours.clear();
+    for (uint32_t t : vertex_triangles[v])
+      for (int k = 0; k < 3; k++)
+        if (triangles[3 * t + k] != v)
+          neighbours.push_back(triangles[3 * t + k]);
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+  };
+
+  // a collapse must keep the surface manifold and not fold triangles over
+  auto valid = [&](uint32_t from, uint32_t to) {
+    gatherNeighbours(from, from_neighbours);
+    gatherNeighbours(to, to_neighbours);
+    int shared_triangles = 0;
+    for (uint32_t t : vertex_triangles[from]) {
+      const uint32_t* tri = &triangles[3 * t];
+      if (tri[0] == to || tri[1] == to || tri[2] == to) {
+        shared_triangles++;
+        continue;
+      }
+      glm::vec3 before[3], after[3];
+      for (int k = 0; k < 3; k++) {
+        before[k] = mesh.vertices[tri[k]].position;
+        after[k] = mesh.vertices[tri[k] == from ? to : tri[k]].position;
+      }
+      const glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+      const glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+      const float l0 = glm::length(n0), l1 = glm::length(n1);
+      if (l1 <= 1e-12f || glm::dot(n0, n1) < 0.2f * l0 * l1)
+        return false;
+    }
+    int shared_neighbours = 0;
+    for (uint32_t n : from_neighbours)
+      if (std::binary_search(to_neighbours.begin(), to_neighbours.end(), n))
+        shared_neighbours++;
+    return shared_triangles > 0 && shared_neighbours == shared_triangles;
+  };
+
+  size_t remaining = triangle_count;
+  double max_error = 0.0;
+  while (remaining > target_triangles && !queue.empty()) {
+    const Collapse collapse = queue.top();
+    queue.pop();
+    const uint32_t from = collapse.from, to = collapse.to;
+    if (!alive[from] || !alive[to] || collapse.version != version[to] || !valid(from, to))
+      continue;
+
+    // move the triangles of from over to to, dropping the ones on the collapsed edge
+    for (uint32_t t : vertex_triangles[from]) {
+      uint32_t* tri = &triangles[3 * t];
+      if (tri[0] == to || tri[1] == to || tri[2] == to) {
+        triangle_alive[t] = false;
+        remaining--;
+        for (int k = 0; k < 3; k++) {
+          std::vector<uint32_t>& list = vertex_triangles[tri[k]];
+          if (tri[k] != from)
+            list.erase(std::find(list.begin(), list.end(), t));
+        }
+        continue;
+      }
+      for (int k = 0; k < 3; k++)
+        if (tri[k] == from)
+          tri[k] = to;
+      vertex_triangles[to].push_back(t);
+    }
+    vertex_triangles[from].clear();
+    alive[from] = false;
+    quadrics[to].add(quadrics[from]);
+    max_error = std::max(max_error, collapse.error);
+
+    // the target's quadric changed, so did every collapse into or out of it
+    version[to]++;
+    gatherNeighbours(to, to_neighbours);
+    for (uint32_t n : to_neighbours) {
+      version[n]++;
+      push(n, to);
+      push(to, n);
+      // collapses into n were versioned away, requeue the ones from its other neighbours
+      gatherNeighbours(n, from_neighbours);
+      for (uint32_t m : from_neighbours)
+        if (m != to)
+          push(m, n);
+    }
+  }
+
+  // compact the vertices still referenced, keeping their order
+  Mesh result;
+  std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+  for (size_t t = 0; t < triangle_count; t++) {
+    if (!triangle_alive[t])
+      continue;
+    for (int k = 0; k < 3; k++)
+      remap[triangles[3 * t + k]] = 0;
+  }
+  for (uint32_t v = 0; v < vertex_count; v++) {
+    if (remap[v] == UINT32_MAX)
+      continue;
+    remap[v] = (uint32_t)result.vertices.size();
+    result.vertices.push_back(mesh.vertices[v]);
+  }
+  for (size_t t = 0; t < triangle_count; t++)
+    if (triangle_alive[t])
+      for (int k = 0; k < 3; k++)
+        result.indices.push_back(remap[triangles[3 * t + k]]);
+
+  if (error)
+    *error = (float)std::sqrt(max_error);
+  return result;
+}
+
+#endif
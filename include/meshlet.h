@@ -0,0 +1,261 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "bounds.h"
+#include "mesh.h"
+
+// A cluster of up to 64 vertices and 124 triangles of a mesh, small enough to be
+// culled as a whole: by its bounding sphere against the frustum and by its normal
+// cone when all of its triangles face away from the camera.
+struct Meshlet {
+  glm::vec3 center;      // bounding sphere
+  float radius;
+  glm::vec3 cone_axis;   // average triangle normal
+  float cone_cutoff;     // sine of the cone's half angle, 1 when the cone is too wide to cull
+  uint32_t vertex_offset;    // first entry in MeshletBuffer::vertices
+  uint32_t triangle_offset;  // first entry in MeshletBuffer::triangles
+  uint32_t vertex_count;
+  uint32_t triangle_count;
+};
+
+// every meshlet of a mesh in contiguous arrays
+struct MeshletBuffer {
+  // culling data of four consecutive meshlets, one SIMD register per field
+  struct alignas(16) Bounds {
+    float center_x[4], center_y[4], center_z[4], radius[4];
+    float axis_x[4], axis_y[4], axis_z[4], cutoff[4];
+  };
+
+  std::vector<Meshlet> meshlets;
+  std::vector<uint32_t> vertices;  // mesh vertex of each meshlet vertex
+  std::vector<uint8_t> triangles;  // three meshlet vertices per triangle
+  std::vector<Bounds> bounds;      // (meshlets.size() + 3) / 4 blocks, padding lanes never visible
+};
+
+// bounding sphere and normal cone of a meshlet whose vertices and triangles are in buffer
+inline void computeMeshletBounds(const Mesh& mesh, const MeshletBuffer& buffer, Meshlet& meshlet) {
+  // Ritter's sphere: start from two far apart points and grow to take in the rest
+  auto position = [&](uint32_t i) { return mesh.vertices[buffer.vertices[meshlet.vertex_offset + i]].position; };
+  glm::vec3 a = position(0), b = a;
+  for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+    if (glm::dot(position(i) - a, position(i) - a) > glm::dot(b - a, b - a))
+      b = position(i);
+  for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+    if (glm::dot(position(i) - b, position(i) - b) > glm::dot(a - b, a - b))
+      a = position(i);
+  glm::vec3 center = 0.5f * (a + b);
+  float radius = 0.5f * glm::length(b - a);
+  for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+    const float distance = glm::length(position(i) - center);
+    if (distance > radius) {
+      const float grown = 0.5f * (radius + distance);
+      center += (grown - radius) / distance * (position(i) - center);
+      radius = grown;
+    }
+  }
+  meshlet.center = center;
+  meshlet.radius = radius;
+
+  // normal cone around the average normal, as wide as the normal furthest from it
+  std::vector<glm::vec3> normals;
+  glm::vec3 sum(0.0f);
+  for (uint32_t t = 0; t < meshlet.triangle_count; t++) {
+    const uint8_t* tri = &buffer.triangles[meshlet.triangle_offset + 3 * t];
+    const glm::vec3 p0 = position(tri[0]), p1 = position(tri[1]), p2 = position(tri[2]);
+    const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    const float length = glm::length(normal);
+    if (length > 0.0f) {
+      normals.push_back(normal / length);
+      sum += normals.back();
+    }
+  }
+  const float sum_length = glm::length(sum);
+  meshlet.cone_axis = sum_length > 0.0f ? sum / sum_length : glm::vec3(0.0f, 0.0f, 1.0f);
+  float min_dot = sum_length > 0.0f ? 1.0f : -1.0f;
+  for (const glm::vec3& normal : normals)
+    min_dot = std::min(min_dot, glm::dot(normal, meshlet.cone_axis));
+  // past 90 degrees some triangle always faces the camera
+  meshlet.cone_cutoff = min_dot <= 0.0f ? 1.0f : std::sqrt(1.0f - min_dot * min_dot);
+}
+
+// Split mesh into meshlets. Each one grows from a seed triangle by adding the neighbouring
+// triangle that brings the fewest new vertices, so meshlets end up compact and share few vertices.
+inline MeshletBuffer buildMeshlets(const Mesh& mesh, uint32_t max_vertices = 64, uint32_t max_triangles = 124) {
+  const uint32_t vertex_count = (uint32_t)mesh.vertices.size();
+  const uint32_t triangle_count = (uint32_t)mesh.triangleCount();
+
+  // triangles around each vertex
+  std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+  for (uint32_t index : mesh.indices)
+    adjacency_offsets[index + 1]++;
+  for (uint32_t v = 0; v < vertex_count; v++)
+    adjacency_offsets[v + 1] += adjacency_offsets[v];
+  std::vector<uint32_t> adjacency(mesh.indices.size());
+  {
+    std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (uint32_t i = 0; i < (uint32_t)mesh.indices.size(); i++)
+      adjacency[fill[mesh.indices[i]]++] = i / 3;
+  }
+
+  MeshletBuffer buffer;
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<int> local(vertex_count, -1);  // index of a vertex in the current meshlet
+  std::vector<uint32_t> candidates;
+  Meshlet meshlet = {};
+
+  auto finish = [&]() {
+    if (meshlet.triangle_count == 0)
+      return;
+    computeMeshletBounds(mesh, buffer, meshlet);
+    buffer.meshlets.push_back(meshlet);
+    for (uint32_t i = meshlet.vertex_offset; i < buffer.vertices.size(); i++)
+      local[buffer.vertices[i]] = -1;
+    meshlet = {};
+    meshlet.vertex_offset = (uint32_t)buffer.vertices.size();
+    meshlet.triangle_offset = (uint32_t)buffer.triangles.size();
+    candidates.clear();
+  };
+  auto newVertices = [&](uint32_t t) {
+    return (local[mesh.indices[3 * t]] < 0) + (local[mesh.indices[3 * t + 1]] < 0) +
+           (local[mesh.indices[3 * t + 2]] < 0);
+  };
+
+  uint32_t seed = 0;
+  for (uint32_t added = 0; added < triangle_count; added++) {
+    // best neighbour of the meshlet, or the next unused triangle to start one from
+    uint32_t best = UINT32_MAX;
+    int best_new = 4;
+    size_t kept = 0;
+    for (uint32_t t : candidates) {
+      if (emitted[t])
+        continue;
+      candidates[kept++] = t;
+      const int new_vertices = newVertices(t);
+      if (new_vertices < best_new) {
+        best = t;
+        best_new = new_vertices;
+      }
+    }
+    candidates.resize(kept);
+    if (best == UINT32_MAX) {
+      while (emitted[seed])
+        seed++;
+      best = seed;
+      best_new = newVertices(best);
+    }
+    if (meshlet.vertex_count + best_new > max_vertices || meshlet.triangle_count + 1 > max_triangles) {
+      finish();
+    }
+
+    emitted[best] = true;
+    for (int k = 0; k < 3; k++) {
+      const uint32_t v = mesh.indices[3 * best + k];
+      if (local[v] < 0) {
+        local[v] = (int)meshlet.vertex_count++;
+        buffer.vertices.push_back(v);
+        for (uint32_t i = adjacency_offsets[v]; i < adjacency_offsets[v + 1]; i++)
+          if (!emitted[adjacency[i]])
+            candidates.push_back(adjacency[i]);
+      }
+      buffer.triangles.push_back((uint8_t)local[v]);
+    }
+    meshlet.triangle_count++;
+  }
+  finish();
+
+  // pack the culling data four meshlets at a time, padding lanes with spheres outside every frustum
+  buffer.bounds.resize((buffer.meshlets.size() + 3) / 4);
+  for (size_t i = 0; i < buffer.bounds.size() * 4; i++) {
+    MeshletBuffer::Bounds& block = buffer.bounds[i / 4];
+    const int lane = i % 4;
+    const Meshlet padding = {glm::vec3(0.0f), -INFINITY, glm::vec3(0.0f, 0.0f, 1.0f), 1.0f, 0, 0, 0, 0};
+    const Meshlet& m = i < buffer.meshlets.size() ? buffer.meshlets[i] : padding;
+    block.center_x[lane] = m.center.x;
+    block.center_y[lane] = m.center.y;
+    block.center_z[lane] = m.center.z;
+    block.radius[lane] = m.radius;
+    block.axis_x[lane] = m.cone_axis.x;
+    block.axis_y[lane] = m.cone_axis.y;
+    block.axis_z[lane] = m.cone_axis.z;
+    block.cutoff[lane] = m.cone_cutoff;
+  }
+  return buffer;
+}
+
+// bit per lane of a bounds block set when that meshlet may be visible
+inline int testMeshletBounds(const MeshletBuffer::Bounds& block, const Frustum& frustum, const glm::vec3& camera) {
+#if defined(__SSE2__)
+  const __m128 center_x = _mm_load_ps(block.center_x);
+  const __m128 center_y = _mm_load_ps(block.center_y);
+  const __m128 center_z = _mm_load_ps(block.center_z);
+  const __m128 radius = _mm_load_ps(block.radius);
+
+  // sphere in front of every plane
+  __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  for (const glm::vec4& plane : frustum.planes) {
+    const __m128 distance = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(center_x, _mm_set1_ps(plane.x)), _mm_mul_ps(center_y, _mm_set1_ps(plane.y))),
+        _mm_add_ps(_mm_mul_ps(center_z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+    visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+  }
+
+  // back facing when the view direction is inside the cone mirrored to the back, widened by the sphere:
+  // dot(center - camera, axis) >= cutoff * |center - camera| + radius
+  const __m128 view_x = _mm_sub_ps(center_x, _mm_set1_ps(camera.x));
+  const __m128 view_y = _mm_sub_ps(center_y, _mm_set1_ps(camera.y));
+  const __m128 view_z = _mm_sub_ps(center_z, _mm_set1_ps(camera.z));
+  const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(view_x, view_x), _mm_mul_ps(view_y, view_y)),
+                                                 _mm_mul_ps(view_z, view_z)));
+  const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(view_x, _mm_load_ps(block.axis_x)),
+                                             _mm_mul_ps(view_y, _mm_load_ps(block.axis_y))),
+                                  _mm_mul_ps(view_z, _mm_load_ps(block.axis_z)));
+  const __m128 back_facing = _mm_cmpge_ps(along, _mm_add_ps(_mm_mul_ps(_mm_load_ps(block.cutoff), distance), radius));
+  return _mm_movemask_ps(_mm_andnot_ps(back_facing, visible));
+#else
+  int mask = 0;
+  for (int lane = 0; lane < 4; lane++) {
+    const glm::vec3 center(block.center_x[lane], block.center_y[lane], block.center_z[lane]);
+    const glm::vec3 axis(block.axis_x[lane], block.axis_y[lane], block.axis_z[lane]);
+    bool visible = true;
+    for (const glm::vec4& plane : frustum.planes)
+      visible = visible && glm::dot(glm::vec3(plane), center) + plane.w + block.radius[lane] >= 0.0f;
+    const glm::vec3 view = center - camera;
+    if (visible && glm::dot(view, axis) < block.cutoff[lane] * glm::length(view) + block.radius[lane])
+      mask |= 1 << lane;
+  }
+  return mask;
+#endif
+}
+
+// Append the triangles of the meshlets that may be visible to indices, as mesh vertex indices,
+// returns the number of meshlets kept. frustum and camera are in the mesh's object space,
+// Frustum::fromMatrix(projection * view * model) gives that frustum.
+inline size_t cullMeshlets(const MeshletBuffer& buffer, const Frustum& frustum, const glm::vec3& camera,
+                           std::vector<uint32_t>& indices) {
+  size_t kept = 0;
+  for (size_t block = 0; block < buffer.bounds.size(); block++) {
+    for (int mask = testMeshletBounds(buffer.bounds[block], frustum, camera); mask; mask &= mask - 1) {
+      const int lane = __builtin_ctz(mask);
+      const Meshlet& meshlet = buffer.meshlets[block * 4 + lane];
+      const uint32_t* vertices = &buffer.vertices[meshlet.vertex_offset];
+      const uint8_t* triangles = &buffer.triangles[meshlet.triangle_offset];
+      for (uint32_t i = 0; i < 3 * meshlet.triangle_count; i++)
+        indices.push_back(vertices[triangles[i]]);
+      kept++;
+    }
+  }
+  return kept;
+}
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace png_detail {
+
+inline uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> table(256);
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+    return table;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+inline uint32_t adler32(const uint8_t* data, size_t size) {
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return b << 16 | a;
+}
+
+// deflate's bits go out least significant first, Huffman codes most significant first
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+  void bits(uint32_t value, int count) {
+    buffer_ |= (uint64_t)value << count_;
+    count_ += count;
+    while (count_ >= 8) {
+      out_.push_back((uint8_t)buffer_);
+      buffer_ >>= 8;
+      count_ -= 8;
+    }
+  }
+  void code(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+      reversed |= ((code >> i) & 1) << (length - 1 - i);
+    bits(reversed, length);
+  }
+  void flush() {
+    if (count_ > 0)
+      out_.push_back((uint8_t)buffer_);
+    buffer_ = 0;
+    count_ = 0;
+  }
+
+private:
+  std::vector<uint8_t>& out_;
+  uint64_t buffer_ = 0;
+  int count_ = 0;
+};
+
+// the fixed literal/length code of RFC 1951 3.2.6
+inline void writeSymbol(BitWriter& writer, int symbol) {
+  if (symbol < 144)
+    writer.code(0x30 + symbol, 8);
+  else if (symbol < 256)
+    writer.code(0x190 + symbol - 144, 9);
+  else if (symbol < 280)
+    writer.code(symbol - 256, 7);
+  else
+    writer.code(0xc0 + symbol - 280, 8);
+}
+
+inline void writeMatch(BitWriter& writer, int length, int distance) {
+  static const int LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const int LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const int DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                        8193, 12289, 16385, 24577};
+  static const int DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                         7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+  int code = 28;
+  while (LENGTH_BASE[code] > length)
+    code--;
+  writeSymbol(writer, 257 + code);
+  writer.bits(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+  code = 29;
+  while (DISTANCE_BASE[code] > distance)
+    code--;
+  writer.code(code, 5);
+  writer.bits(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+}
+
+// zlib stream of data, one final block with fixed codes
+inline std::vector<uint8_t> deflate(const std::vector<uint8_t>& data) {
+  const int WINDOW = 32768;
+  const int HASH_SIZE = 1 << 15;
+  const int MAX_CHAIN = 32;
+  const int MIN_MATCH = 3, MAX_MATCH = 258;
+
+  std::vector<uint8_t> out = {0x78, 0x01};
+  BitWriter writer(out);
+  writer.bits(1, 1);   // final block
+  writer.bits(1, 2);   // fixed Huffman codes
+
+  const size_t size = data.size();
+  std::vector<int> head(HASH_SIZE, -1), previous(WINDOW, -1);
+  auto hash = [&](size_t i) {
+    return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (HASH_SIZE - 1);
+  };
+  auto insert = [&](size_t i) {
+    if (i + MIN_MATCH > size)
+      return;
+    const int h = hash(i);
+    previous[i % WINDOW] = head[h];
+    head[h] = (int)i;
+  };
+
+  size_t i = 0;
+  while (i < size) {
+    int best_length = 0, best_distance = 0;
+    if (i + MIN_MATCH <= size) {
+      const size_t max_length = std::min<size_t>(MAX_MATCH, size - i);
+      int candidate = head[hash(i)];
+      for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN; chain++) {
+        const size_t distance = i - candidate;
+        if (distance > (size_t)WINDOW - 1)
+          break;
+        size_t length = 0;
+        while (length < max_length && data[candidate + length] == data[i + length])
+          length++;
+        if ((int)length > best_length) {
+          best_length = (int)length;
+          best_distance = (int)distance;
+          if (length == max_length)
+            break;
+        }
+        const int next = previous[candidate % WINDOW];
+        if (next >= candidate)
+          break;   // the slot was reused by a newer position
+        candidate = next;
+      }
+    }
+    if (best_length >= MIN_MATCH) {
+      writeMatch(writer, best_length, best_distance);
+      for (int k = 0; k < best_length; k++)
+        insert(i + k);
+      i += best_length;
+    }
+    else {
+      writeSymbol(writer, data[i]);
+      insert(i);
+      i++;
+    }
+  }
+  writeSymbol(writer, 256);   // end of block
+  writer.flush();
+
+  const uint32_t adler = adler32(data.data(), size);
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back((uint8_t)(adler >> shift));
+  return out;
+}
+
+inline void writeChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+  const uint32_t size = (uint32_t)data.size();
+  const uint8_t size_bytes[4] = {(uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size};
+  file.write((const char*)size_bytes, 4);
+  file.write(type, 4);
+  file.write((const char*)data.data(), data.size());
+  uint32_t crc = crc32((const uint8_t*)type, 4);
+  crc = crc32(data.data(), data.size(), crc);
+  const uint8_t crc_bytes[4] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+  file.write((const char*)crc_bytes, 4);
+}
+
+}  // namespace png_detail
+
+// Minimal PNG writer for 8 bit gray, RGB and RGBA images, rows top to bottom. Each
+// row gets the filter that leaves the smallest residuals, then the image data is
+// deflated in a single block with the fixed Huffman codes and greedy LZ77 matching.
+// Not as small as zlib's output, but rendered frames with their flat backgrounds
+// shrink well enough to keep as reference images.
+inline bool writePng(const std::string& path, int width, int height, int channels, const uint8_t* pixels) {
+  using namespace png_detail;
+  if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4))
+    return false;
+
+  // per row the filter with the smallest sum of absolute residuals: none, sub or up
+  const size_t stride = (size_t)width * channels;
+  std::vector<uint8_t> filtered;
+  filtered.reserve((stride + 1) * height);
+  std::vector<uint8_t> candidates[3] = {std::vector<uint8_t>(stride), std::vector<uint8_t>(stride),
+                                        std::vector<uint8_t>(stride)};
+  for (int y = 0; y < height; y++) {
+    const uint8_t* row = pixels + y * stride;
+    const uint8_t* above = y > 0 ? row - stride : nullptr;
+    int best = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for (int filter = 0; filter < 3; filter++) {
+      uint64_t cost = 0;
+      for (size_t x = 0; x < stride; x++) {
+        uint8_t predictor = 0;
+        if (filter == 1 && x >= (size_t)channels)
+          predictor = row[x - channels];
+        else if (filter == 2 && above)
+          predictor = above[x];
+        const uint8_t residual = row[x] - predictor;
+        candidates[filter][x] = residual;
+        cost += residual < 128 ? residual : 256 - residual;
+      }
+      if (cost < best_cost) {
+        best_cost = cost;
+        best = filter;
+      }
+    }
+    filtered.push_back((uint8_t)best);
+    filtered.insert(filtered.end(), candidates[best].begin(), candidates[best].end());
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  file.write((const char*)SIGNATURE, 8);
+  const uint8_t color_type = channels == 1 ? 0 : channels == 3 ? 2 : 6;
+  const std::vector<uint8_t> header = {
+    (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+    (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+    8, color_type, 0, 0, 0
+  };
+  writeChunk(file, "IHDR", header);
+  writeChunk(file, "IDAT", deflate(filtered));
+  writeChunk(file, "IEND", {});
+  return (bool)file;
+}
+
+#endif
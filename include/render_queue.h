@@ -0,0 +1,151 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Draws to submit this frame, each with a 64-bit key packing the state it needs and
+// its depth so that sorting the keys is all the ordering there is. Opaque draws come
+// first, grouped by program, texture set, material and vertex array so each state is
+// bound once, then front to back within a group so the depth test rejects early.
+// Translucent draws come last and strictly back to front, their state breaking ties.
+//
+//   opaque:       0 | program:8 | textures:8 | material:8 | vao:8 | depth:24
+//   translucent:  1 | ~depth:24 | program:8 | textures:8 | material:8 | vao:8
+//
+// The state ids are the caller's small indices into its own tables, not GL names.
+class RenderQueue {
+public:
+  struct Item {
+    uint64_t key;
+    uint32_t index;   // the caller's draw
+  };
+
+  // what a draw binds, in the order the keys group by
+  struct State {
+    uint8_t program = 0;
+    uint8_t textures = 0;
+    uint8_t material = 0;
+    uint8_t vao = 0;
+  };
+
+  // state changes submitting the items in order costs, the first draw's binds included
+  struct StateChanges {
+    size_t programs = 0;
+    size_t textures = 0;
+    size_t materials = 0;
+    size_t vaos = 0;
+    size_t blending = 0;   // switches between opaque and translucent
+  };
+
+  static const int DEPTH_BITS = 24;
+  static const uint32_t MAX_DEPTH = (1u << DEPTH_BITS) - 1;
+
+  // distance from the camera in [near_plane, far_plane] as an integer keeping its order
+  static uint32_t quantizeDepth(float distance, float near_plane, float far_plane);
+
+  static uint64_t opaqueKey(const State& state, uint32_t depth);
+  static uint64_t translucentKey(const State& state, uint32_t depth);
+
+  static bool translucent(uint64_t key) { return (key >> 63) != 0; }
+  static State state(uint64_t key);
+
+  void clear() { items_.clear(); }
+  void push(uint64_t key, uint32_t index) { items_.push_back(Item{key, index}); }
+  // room for count items filled through operator[], from several threads if need be
+  void resize(size_t count) { items_.resize(count); }
+  Item& operator[](size_t i) { return items_[i]; }
+  size_t size() const { return items_.size(); }
+  const Item* begin() const { return items_.data(); }
+  const Item* end() const { return items_.data() + items_.size(); }
+
+  // stable LSD radix sort on the keys, a byte per pass, skipping the bytes all keys share
+  void sort();
+
+  StateChanges stateChanges() const;
+
+private:
+  static uint64_t packState(const State& state) {
+    return (uint64_t)state.program << 24 | (uint64_t)state.textures << 16 | (uint64_t)state.material << 8 | state.vao;
+  }
+
+  std::vector<Item> items_;
+  std::vector<Item> scratch_;
+};
+
+inline uint32_t RenderQueue::quantizeDepth(float distance, float near_plane, float far_plane) {
+  const float t = (distance - near_plane) / (far_plane - near_plane);
+  return (uint32_t)(std::min(std::max(t, 0.0f), 1.0f) * MAX_DEPTH);
+}
+
+inline uint64_t RenderQueue::opaqueKey(const State& state, uint32_t depth) {
+  return packState(state) << DEPTH_BITS | (depth & MAX_DEPTH);
+}
+
+inline uint64_t RenderQueue::translucentKey(const State& state, uint32_t depth) {
+  return uint64_t(1) << 63 | (uint64_t)(MAX_DEPTH - (depth & MAX_DEPTH)) << 32 | packState(state);
+}
+
+inline RenderQueue::State RenderQueue::state(uint64_t key) {
+  const uint32_t packed = (uint32_t)(translucent(key) ? key : key >> DEPTH_BITS);
+  State state;
+  state.program = (uint8_t)(packed >> 24);
+  state.textures = (uint8_t)(packed >> 16);
+  state.material = (uint8_t)(packed >> 8);
+  state.vao = (uint8_t)packed;
+  return state;
+}
+
+inline void RenderQueue::sort() {
+  const size_t count = items_.size();
+  if (count < 2)
+    return;
+
+  // histograms of all eight bytes in one pass
+  size_t histograms[8][256] = {};
+  for (const Item& item : items_) {
+    for (int byte = 0; byte < 8; byte++)
+      histograms[byte][(item.key >> (8 * byte)) & 0xff]++;
+  }
+
+  scratch_.resize(count);
+  Item* from = items_.data();
+  Item* to = scratch_.data();
+  for (int byte = 0; byte < 8; byte++) {
+    size_t* histogram = histograms[byte];
+    if (histogram[(from[0].key >> (8 * byte)) & 0xff] == count)
+      continue;   // every key has the same byte here, nothing to reorder
+    size_t offset = 0;
+    for (int digit = 0; digit < 256; digit++) {
+      const size_t digit_count = histogram[digit];
+      histogram[digit] = offset;
+      offset += digit_count;
+    }
+    for (size_t i = 0; i < count; i++)
+      to[histogram[(from[i].key >> (8 * byte)) & 0xff]++] = from[i];
+    std::swap(from, to);
+  }
+  if (from != items_.data())
+    items_.swap(scratch_);
+}
+
+inline RenderQueue::StateChanges RenderQueue::stateChanges() const {
+  StateChanges changes;
+  for (size_t i = 0; i < items_.size(); i++) {
+    const State current = state(items_[i].key);
+    const bool first = i == 0;
+    const State previous = first ? State() : state(items_[i - 1].key);
+    // a new program needs its material uniforms set again
+    const bool program_changed = first || current.program != previous.program;
+    changes.programs += program_changed;
+    changes.textures += first || current.textures != previous.textures;
+    changes.materials += program_changed || current.material != previous.material;
+    changes.vaos += first || current.vao != previous.vao;
+    changes.blending += !first && translucent(items_[i].key) != translucent(items_[i - 1].key);
+  }
+  return changes;
+}
+
+#endif
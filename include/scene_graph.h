@@ -0,0 +1,193 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <thirdparty/glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Hierarchy of local transforms flattened breadth first, so every parent is stored
+// before its children and the nodes of one depth form a contiguous range. An update
+// walks the levels in order: a node is recomputed only if its own local matrix
+// changed or its parent's world matrix did, so a static scene costs nothing and
+// an animated one only its changed subtrees. Nodes of one level do not depend on
+// each other and are handed out in chunks to the parallel for, which runs them
+// serially unless a job system is plugged in.
+class SceneGraph {
+public:
+  typedef uint32_t NodeId;
+  static constexpr NodeId NO_PARENT = 0xffffffff;
+
+  // run task(0) ... task(task_count - 1), in any order and on any thread, and return when all are done
+  typedef std::function<void(size_t task_count, const std::function<void(size_t task)>& task)> ParallelFor;
+
+  // ids stay valid as nodes are added, their position in the flattened arrays does not
+  NodeId addNode(const glm::mat4& local, NodeId parent = NO_PARENT);
+  void setLocal(NodeId node, const glm::mat4& local);
+
+  size_t size() const { return parents_.size(); }
+  size_t levelCount() const { return level_begin_.empty() ? 0 : level_begin_.size() - 1; }
+
+  const glm::mat4& local(NodeId node) const { return local_[index_[node]]; }
+  const glm::mat4& world(NodeId node) const { return world_[index_[node]]; }
+
+  // world matrices in breadth first order, valid after update(); index() maps an id into it
+  const glm::mat4* worldMatrices() const { return world_.data(); }
+  size_t index(NodeId node) const { return index_[node]; }
+  // whether the last update() recomputed the world matrix at index
+  bool changed(size_t index) const { return changed_[index] != 0; }
+
+  // chunk_size is the number of nodes per task, small levels stay on the calling thread
+  void setParallelFor(ParallelFor parallel_for, size_t chunk_size = 1024) {
+    parallel_for_ = std::move(parallel_for);
+    chunk_size_ = std::max<size_t>(chunk_size, 1);
+  }
+
+  // recompute the world matrices of changed nodes and their descendants, returns how many
+  size_t update();
+
+private:
+  void flatten();
+  size_t updateRange(size_t begin, size_t end);
+
+  // by id
+  std::vector<NodeId> parents_;
+  std::vector<uint32_t> index_;
+
+  // by breadth first index
+  std::vector<uint32_t> parent_index_;
+  std::vector<glm::mat4> local_;
+  std::vector<glm::mat4> world_;
+  std::vector<uint8_t> dirty_;     // local matrix set since the last update
+  std::vector<uint8_t> changed_;   // world matrix recomputed by the last update
+  std::vector<size_t> level_begin_;
+
+  size_t dirty_count_ = 0;
+  bool any_changed_ = false;
+  bool layout_dirty_ = false;
+
+  ParallelFor parallel_for_;
+  size_t chunk_size_ = 1024;
+};
+
+inline SceneGraph::NodeId SceneGraph::addNode(const glm::mat4& local, NodeId parent) {
+  const NodeId node = (NodeId)parents_.size();
+  // appended for now, put in breadth first order by the next update
+  parents_.push_back(parent);
+  index_.push_back(node);
+  parent_index_.push_back(parent == NO_PARENT ? NO_PARENT : index_[parent]);
+  local_.push_back(local);
+  world_.push_back(local);
+  dirty_.push_back(1);
+  changed_.push_back(0);
+  dirty_count_++;
+  layout_dirty_ = true;
+  return node;
+}
+
+inline void SceneGraph::setLocal(NodeId node, const glm::mat4& local) {
+  const uint32_t i = index_[node];
+  local_[i] = local;
+  if (!dirty_[i]) {
+    dirty_[i] = 1;
+    dirty_count_++;
+  }
+}
+
+inline void SceneGraph::flatten() {
+  const size_t count = parents_.size();
+
+  // children of every node in one array, roots first
+  std::vector<uint32_t> child_begin(count + 2, 0);
+  for (NodeId parent : parents_)
+    child_begin[(parent == NO_PARENT ? 0 : parent + 1) + 1]++;
+  for (size_t i = 1; i < child_begin.size(); i++)
+    child_begin[i] += child_begin[i - 1];
+  std::vector<NodeId> children(count);
+  std::vector<uint32_t> cursor(child_begin.begin(), child_begin.end() - 1);
+  for (NodeId node = 0; node < count; node++)
+    children[cursor[parents_[node] == NO_PARENT ? 0 : parents_[node] + 1]++] = node;
+
+  // breadth first order, one level at a time
+  std::vector<NodeId> order;
+  order.reserve(count);
+  level_begin_.assign(1, 0);
+  order.insert(order.end(), children.begin() + child_begin[0], children.begin() + child_begin[1]);
+  for (size_t begin = 0; begin < order.size();) {
+    const size_t end = order.size();
+    level_begin_.push_back(end);
+    for (size_t i = begin; i < end; i++)
+      order.insert(order.end(), children.begin() + child_begin[order[i] + 1], children.begin() + child_begin[order[i] + 2]);
+    begin = end;
+  }
+
+  std::vector<glm::mat4> local(count), world(count);
+  std::vector<uint8_t> dirty(count), changed(count);
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t old_index = index_[order[i]];
+    local[i] = local_[old_index];
+    world[i] = world_[old_index];
+    dirty[i] = dirty_[old_index];
+    changed[i] = changed_[old_index];
+  }
+  for (size_t i = 0; i < count; i++)
+    index_[order[i]] = (uint32_t)i;
+  for (size_t i = 0; i < count; i++) {
+    const NodeId parent = parents_[order[i]];
+    parent_index_[i] = parent == NO_PARENT ? NO_PARENT : index_[parent];
+  }
+  local_.swap(local);
+  world_.swap(world);
+  dirty_.swap(dirty);
+  changed_.swap(changed);
+  layout_dirty_ = false;
+}
+
+inline size_t SceneGraph::updateRange(size_t begin, size_t end) {
+  size_t updated = 0;
+  for (size_t i = begin; i < end; i++) {
+    const uint32_t parent = parent_index_[i];
+    const bool parent_changed = parent != NO_PARENT && changed_[parent];
+    changed_[i] = dirty_[i] | parent_changed;
+    if (!changed_[i])
+      continue;
+    world_[i] = parent == NO_PARENT ? local_[i] : world_[parent] * local_[i];
+    dirty_[i] = 0;
+    updated++;
+  }
+  return updated;
+}
+
+inline size_t SceneGraph::update() {
+  if (layout_dirty_)
+    flatten();
+  if (dirty_count_ == 0) {
+    // nothing moved, only forget what changed last time
+    if (any_changed_)
+      std::fill(changed_.begin(), changed_.end(), 0);
+    any_changed_ = false;
+    return 0;
+  }
+
+  std::atomic<size_t> updated(0);
+  for (size_t level = 0; level + 1 < level_begin_.size(); level++) {
+    const size_t begin = level_begin_[level], end = level_begin_[level + 1];
+    const size_t tasks = (end - begin + chunk_size_ - 1) / chunk_size_;
+    if (tasks <= 1 || !parallel_for_) {
+      updated += updateRange(begin, end);
+      continue;
+    }
+    parallel_for_(tasks, [&](size_t task) {
+      const size_t task_begin = begin + task * chunk_size_;
+      updated += updateRange(task_begin, std::min(task_begin + chunk_size_, end));
+    });
+  }
+  dirty_count_ = 0;
+  any_changed_ = true;
+  return updated;
+}
+
+#endif
@@ -8,27 +8,39 @@
 #include <sstream>
 #include <iostream>
 
+#include "gl_objects.h"
+#include "trace.h"
+
+// owns its program, which goes with it
 class ShaderProgram {
 public:
   // the program ID
   unsigned int ID;
 
   // constructor reads and builds the shader
-  ShaderProgram(const char* vertex_path, const char* fragment_path);
+  ShaderProgram(const char* vertex_path, const char* fragment_path, const GLCallSite& site = GLCallSite());
+  // constructor reads and builds a compute shader
+  ShaderProgram(const char* compute_path, const GLCallSite& site = GLCallSite());
 
   // activate the shader
   void use() { glUseProgram(ID); }
 
   // utility uniform functions
   void setBool(const std::string &name, bool value) const;
-  void setInt(const std::string &name, bool value) const;
-  void setFloat(const std::string &name, bool value) const;
+  void setInt(const std::string &name, int value) const;
+  void setFloat(const std::string &name, float value) const;
 private:
+  // the file name without its directories, the program's label is made of them
+  static std::string fileName(const char* file_path);
   const std::string readCode(const char* file_path) const;
   unsigned int compileShader(const std::string shader_code, const GLenum shader_type) const;
+  void linkProgram() const;
+
+  GLProgram program_;
 };
 
-ShaderProgram::ShaderProgram(const char* vertex_path, const char* fragment_path) {
+ShaderProgram::ShaderProgram(const char* vertex_path, const char* fragment_path, const GLCallSite& site)
+    : program_(site) {
   // 1. read the vertex/fragment code from files
   const std::string v_shader_code = readCode(vertex_path);
   const std::string f_shader_code = readCode(fragment_path);
@@ -37,34 +49,46 @@ ShaderProgram::ShaderProgram(const char* vertex_path, const char* fragment_path)
   unsigned int vertex = compileShader(v_shader_code, GL_VERTEX_SHADER);
   unsigned int fragment = compileShader(f_shader_code, GL_FRAGMENT_SHADER);
 
-  ID = glCreateProgram();
+  ID = program_;
+  program_.label(fileName(vertex_path) + " " + fileName(fragment_path));
   glAttachShader(ID, vertex);
   glAttachShader(ID, fragment);
-  glLinkProgram(ID);
-  int success;
-  glGetProgramiv(ID, GL_LINK_STATUS, &success);
-  if (!success) {
-    char infoLog[512];
-    glGetProgramInfoLog(ID, 512, NULL, infoLog);
-    std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-  }
+  linkProgram();
   glDeleteShader(vertex);
   glDeleteShader(fragment);
 }
 
+ShaderProgram::ShaderProgram(const char* compute_path, const GLCallSite& site) : program_(site) {
+  const std::string c_shader_code = readCode(compute_path);
+  unsigned int compute = compileShader(c_shader_code, GL_COMPUTE_SHADER);
+
+  ID = program_;
+  program_.label(fileName(compute_path));
+  glAttachShader(ID, compute);
+  linkProgram();
+  glDeleteShader(compute);
+}
+
 void ShaderProgram::setBool(const std::string &name, bool value) const {
   glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
 }
 
-void ShaderProgram::setInt(const std::string &name, bool value) const {
+void ShaderProgram::setInt(const std::string &name, int value) const {
   glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
 }
 
-void ShaderProgram::setFloat(const std::string &name, bool value) const {
+void ShaderProgram::setFloat(const std::string &name, float value) const {
   glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
 }
 
+std::string ShaderProgram::fileName(const char* file_path) {
+  const std::string path = file_path;
+  const size_t slash = path.find_last_of("/\\");
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
 const std::string ShaderProgram::readCode(const char* file_path) const {
+  TRACE_ZONE("read shader");
   std::string code;
   std::ifstream shader_file;
   shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -87,6 +111,7 @@ const std::string ShaderProgram::readCode(const char* file_path) const {
 
 unsigned int ShaderProgram::compileShader(const std::string shader_code,
                                           const GLenum shader_type) const {
+  TRACE_ZONE("compile shader");
   unsigned int shader = glCreateShader(shader_type);
   const char* code = shader_code.c_str();
   glShaderSource(shader, 1, &code, NULL);
@@ -101,4 +126,16 @@ unsigned int ShaderProgram::compileShader(const std::string shader_code,
   return shader;
 }
 
+void ShaderProgram::linkProgram() const {
+  TRACE_ZONE("link program");
+  glLinkProgram(ID);
+  int success;
+  glGetProgramiv(ID, GL_LINK_STATUS, &success);
+  if (!success) {
+    char infoLog[512];
+    glGetProgramInfoLog(ID, 512, NULL, infoLog);
+    std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+  }
+}
+
 #endif
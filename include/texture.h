@@ -0,0 +1,62 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <string>
+
+// the sample's own include may already have brought the implementation along
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <thirdparty/stb_image.h>
+#endif
+
+#include "Config.h"
+#include "gl_objects.h"
+#include "trace.h"
+
+// The samples' image textures: decoded by stb_image, which needs no GL context so
+// it can run on any thread, and uploaded on the context's thread as a mipmapped,
+// repeating GLTexture, so they show up in the GL object accounting and leak report.
+struct Image {
+  int width = 0, height = 0, channels = 0;
+  unsigned char* data = nullptr;
+};
+
+// empty, with the failure on cerr, if the file could not be decoded
+inline Image decodeImage(const std::string& path) {
+  TRACE_ZONE("decode texture");
+  Image image;
+  image.data = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+  if (!image.data)
+    std::cerr << "Failed to load texture\n";
+  return image;
+}
+
+// the image as the texture's level 0 and its mipmaps, then the pixels are freed;
+// an empty image leaves the texture without levels
+inline void uploadImage(GLTexture& texture, Image& image, GLenum format) {
+  TRACE_ZONE("upload texture");
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  if (image.data) {
+    texture.image2D(0, format, image.width, image.height, format, GL_UNSIGNED_BYTE, image.data);
+    texture.generateMipmap();
+  }
+  stbi_image_free(image.data);
+  image.data = nullptr;
+}
+
+// decodes and uploads on the calling thread, the texture counted where this was called
+inline GLTexture loadTexture(const std::string& path, GLenum format, const GLCallSite& site = GLCallSite()) {
+  TRACE_ZONE("load texture");
+  Image image = decodeImage(path);
+  GLTexture texture(site);
+  uploadImage(texture, image, format);
+  return texture;
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// CPU trace zones for a timeline of startup and frames:
+//
+//   TRACE_ZONE("decode texture");          // from here to the end of the block
+//   TRACE_ZONE_BEGIN(update, "update");    // from here to TRACE_ZONE_END(update)
+//   TRACE_THREAD_NAME("loader");           // how the thread is labelled
+//
+// Every thread appends to its own fixed size buffer, created the first time it
+// records, so recording takes no lock and never allocates: two timestamp reads and
+// a few stores. Timestamps are the TSC on x86, scaled to nanoseconds against
+// steady_clock when the trace is written, and steady_clock elsewhere. A full
+// buffer drops further events rather than growing.
+//
+// writeJson() writes Chrome's trace_event format, chrome://tracing and
+// ui.perfetto.dev both open it; zones() hands them to reports in the process, like
+// the startup breakdown. Without TRACING defined the zones compile to nothing and
+// only what is recorded through Trace and TraceZone directly remains.
+class Trace {
+public:
+  static constexpr size_t EVENTS_PER_THREAD = 1 << 16;
+
+  static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  // a zone on the calling thread from begin to end, both from now()
+  static void record(const char* name, uint64_t begin, uint64_t end);
+  static void setThreadName(const std::string& name);
+
+  // everything recorded so far, the threads may keep recording meanwhile
+  static bool writeJson(const std::string& path);
+
+  struct Zone {
+    uint32_t thread;
+    const char* name;
+    double begin_ms, end_ms;   // since the trace started, about when the process did
+  };
+  // the zones recorded so far on every thread, in the order each thread recorded them
+  static std::vector<Zone> zones();
+  // the thread field of the zones the calling thread records
+  static uint32_t threadId() { return threadBuffer().id; }
+
+private:
+  struct Event {
+    const char* name;
+    uint64_t begin, end;
+  };
+
+  // written by its thread only, count is published after the event it covers; name
+  // is read by the exports, so it changes under the registry's mutex
+  struct ThreadBuffer {
+    uint32_t id;
+    std::string name;
+    std::unique_ptr<Event[]> events;
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> dropped{0};
+  };
+
+  // every thread's buffer for as long as the process runs, the threads may be gone by the export
+  struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    const uint64_t start = now();
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  };
+
+  static ThreadBuffer& threadBuffer();
+  // ticks from now() to microseconds, timed against steady_clock since the trace started
+  static double microsecondsPerTick();
+
+  static Registry registry_;
+};
+
+inline Trace::Registry Trace::registry_;
+
+// records the enclosing block or up to end(), TRACE_ZONE declares one
+class TraceZone {
+public:
+  explicit TraceZone(const char* name) : name_(name), begin_(Trace::now()) {}
+  ~TraceZone() { end(); }
+
+  void end() {
+    if (name_)
+      Trace::record(name_, begin_, Trace::now());
+    name_ = nullptr;
+  }
+
+  TraceZone(const TraceZone&) = delete;
+  TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+  const char* name_;
+  uint64_t begin_;
+};
+
+#ifdef TRACING
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_ZONE_BEGIN(zone, name) TraceZone trace_##zone(name)
+#define TRACE_ZONE_END(zone) trace_##zone.end()
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#else
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_ZONE_BEGIN(zone, name) ((void)0)
+#define TRACE_ZONE_END(zone) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+inline Trace::ThreadBuffer& Trace::threadBuffer() {
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (!buffer) {
+    std::lock_guard<std::mutex> lock(registry_.mutex);
+    auto thread = std::make_unique<ThreadBuffer>();
+    thread->id = (uint32_t)registry_.threads.size() + 1;
+    thread->name = "thread " + std::to_string(thread->id);
+    thread->events.reset(new Event[EVENTS_PER_THREAD]);
+    buffer = thread.get();
+    registry_.threads.push_back(std::move(thread));
+  }
+  return *buffer;
+}
+
+inline void Trace::setThreadName(const std::string& name) {
+  ThreadBuffer& buffer = threadBuffer();   // registers the thread under the mutex itself
+  std::lock_guard<std::mutex> lock(registry_.mutex);
+  buffer.name = name;
+}
+
+inline void Trace::record(const char* name, uint64_t begin, uint64_t end) {
+  ThreadBuffer& buffer = threadBuffer();
+  const size_t count = buffer.count.load(std::memory_order_relaxed);
+  if (count == EVENTS_PER_THREAD) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer.events[count] = Event{name, begin, end};
+  buffer.count.store(count + 1, std::memory_order_release);
+}
+
+inline double Trace::microsecondsPerTick() {
+  const uint64_t end = now();
+  const double elapsed_ns =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - registry_.start_time).count();
+  return end > registry_.start ? elapsed_ns / (end - registry_.start) * 1e-3 : 1e-3;
+}
+
+inline std::vector<Trace::Zone> Trace::zones() {
+  const double ms_per_tick = microsecondsPerTick() * 1e-3;
+  auto milliseconds = [&](uint64_t ticks) {
+    return ticks > registry_.start ? (ticks - registry_.start) * ms_per_tick : 0.0;
+  };
+  std::vector<Zone> zones;
+  std::lock_guard<std::mutex> lock(registry_.mutex);
+  for (const auto& thread : registry_.threads) {
+    const size_t count = thread->count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; i++) {
+      const Event& event = thread->events[i];
+      zones.push_back(Zone{thread->id, event.name, milliseconds(event.begin), milliseconds(event.end)});
+    }
+  }
+  return zones;
+}
+
+inline bool Trace::writeJson(const std::string& path) {
+  std::ofstream file(path);
+  if (!file)
+    return false;
+
+  const uint64_t end = now();
+  const double us_per_tick = microsecondsPerTick();
+  auto microseconds = [&](uint64_t ticks) {
+    return ticks > registry_.start ? (ticks - registry_.start) * us_per_tick : 0.0;
+  };
+
+  std::lock_guard<std::mutex> lock(registry_.mutex);
+  file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << std::fixed << std::setprecision(3);
+  bool first = true;
+  for (const auto& thread : registry_.threads) {
+    file << (first ? "" : ",") << "\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << thread->id
+         << ", \"args\": {\"name\": \"" << thread->name << "\"}}";
+    first = false;
+    const size_t count = thread->count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; i++) {
+      const Event& event = thread->events[i];
+      const double begin = microseconds(event.begin);
+      file << ",\n{\"ph\": \"X\", \"name\": \"" << event.name << "\", \"pid\": 1, \"tid\": " << thread->id
+           << ", \"ts\": " << begin << ", \"dur\": " << microseconds(event.end) - begin << "}";
+    }
+    const size_t dropped = thread->dropped.load(std::memory_order_relaxed);
+    if (dropped)
+      file << ",\n{\"ph\": \"i\", \"s\": \"t\", \"name\": \"" << dropped << " events dropped, buffer full\", "
+           << "\"pid\": 1, \"tid\": " << thread->id << ", \"ts\": " << microseconds(end) << "}";
+  }
+  file << "\n]}\n";
+  return (bool)file;
+}
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORM_X86
+#endif
+
+// Translation, rotation and scale of many objects stored as structure of arrays,
+// one array per component, so model matrices are composed several objects at a time:
+// eight per step with AVX2, four with SSE, one in the scalar fallback. The kernel is
+// picked at runtime from what the CPU supports.
+class TransformArray {
+public:
+  enum Component { TX, TY, TZ, QX, QY, QZ, QW, SX, SY, SZ, COMPONENT_COUNT };
+  enum class Kernel { Scalar, SSE, AVX2 };
+
+  explicit TransformArray(size_t count = 0) { resize(count); }
+
+  // new transforms are the identity
+  void resize(size_t count);
+  size_t size() const { return count_; }
+
+  void set(size_t i, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+  void setTranslation(size_t i, const glm::vec3& translation);
+  void setRotation(size_t i, const glm::quat& rotation);
+  void setScale(size_t i, const glm::vec3& scale);
+
+  // one component of every transform, for loops animating many objects at once
+  float* component(Component c) { return components_[c].data(); }
+  const float* component(Component c) const { return components_[c].data(); }
+
+  // write the matrices translate * rotate * scale of transforms [first, first + count)
+  // to out, stride bytes apart (a mapped instance buffer works, every byte gets written)
+  void compose(size_t first, size_t count, void* out, size_t stride = sizeof(glm::mat4)) const {
+    compose(first, count, out, stride, bestKernel());
+  }
+  void compose(size_t first, size_t count, void* out, size_t stride, Kernel kernel) const;
+
+  static Kernel bestKernel();
+
+private:
+  void composeScalar(size_t first, size_t last, char* out, size_t stride) const;
+#if defined(TRANSFORM_X86)
+  size_t composeSSE(size_t first, size_t last, char* out, size_t stride) const;
+  __attribute__((target("avx2"))) size_t composeAVX2(size_t first, size_t last, char* out, size_t stride) const;
+#endif
+
+  size_t count_ = 0;
+  std::vector<float> components_[COMPONENT_COUNT];
+};
+
+inline void TransformArray::resize(size_t count) {
+  const float identity[COMPONENT_COUNT] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+  for (int c = 0; c < COMPONENT_COUNT; c++)
+    components_[c].resize(count, identity[c]);
+  count_ = count;
+}
+
+inline void TransformArray::set(size_t i, const glm::vec3& translation, const glm::quat& rotation,
+                                const glm::vec3& scale) {
+  setTranslation(i, translation);
+  setRotation(i, rotation);
+  setScale(i, scale);
+}
+
+inline void TransformArray::setTranslation(size_t i, const glm::vec3& translation) {
+  components_[TX][i] = translation.x;
+  components_[TY][i] = translation.y;
+  components_[TZ][i] = translation.z;
+}
+
+inline void TransformArray::setRotation(size_t i, const glm::quat& rotation) {
+  components_[QX][i] = rotation.x;
+  components_[QY][i] = rotation.y;
+  components_[QZ][i] = rotation.z;
+  components_[QW][i] = rotation.w;
+}
+
+inline void TransformArray::setScale(size_t i, const glm::vec3& scale) {
+  components_[SX][i] = scale.x;
+  components_[SY][i] = scale.y;
+  components_[SZ][i] = scale.z;
+}
+
+inline TransformArray::Kernel TransformArray::bestKernel() {
+#if defined(TRANSFORM_X86)
+  static const Kernel kernel = __builtin_cpu_supports("avx2") ? Kernel::AVX2 : Kernel::SSE;
+  return kernel;
+#else
+  return Kernel::Scalar;
+#endif
+}
+
+inline void TransformArray::compose(size_t first, size_t count, void* out, size_t stride, Kernel kernel) const {
+  char* bytes = static_cast<char*>(out);
+  const size_t last = first + count;
+  // the vector kernels stop before a partial batch, the scalar one finishes it
+  size_t done = first;
+#if defined(TRANSFORM_X86)
+  if (kernel == Kernel::AVX2)
+    done = composeAVX2(first, last, bytes, stride);
+  else if (kernel == Kernel::SSE)
+    done = composeSSE(first, last, bytes, stride);
+#endif
+  composeScalar(done, last, bytes + (done - first) * stride, stride);
+}
+
+// rotation matrix of unit quaternion (x, y, z, w) times the scale, column by column:
+//   | 1 - 2(yy + zz)   2(xy - wz)       2(xz + wy)     |
+//   | 2(xy + wz)       1 - 2(xx + zz)   2(yz - wx)     |
+//   | 2(xz - wy)       2(yz + wx)       1 - 2(xx + yy) |
+inline void TransformArray::composeScalar(size_t first, size_t last, char* out, size_t stride) const {
+  for (size_t i = first; i < last; i++, out += stride) {
+    const float x = components_[QX][i], y = components_[QY][i], z = components_[QZ][i], w = components_[QW][i];
+    const float sx = components_[SX][i], sy = components_[SY][i], sz = components_[SZ][i];
+    float* m = reinterpret_cast<float*>(out);
+    m[0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+    m[1] = 2.0f * (x * y + w * z) * sx;
+    m[2] = 2.0f * (x * z - w * y) * sx;
+    m[3] = 0.0f;
+    m[4] = 2.0f * (x * y - w * z) * sy;
+    m[5] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+    m[6] = 2.0f * (y * z + w * x) * sy;
+    m[7] = 0.0f;
+    m[8] = 2.0f * (x * z + w * y) * sz;
+    m[9] = 2.0f * (y * z - w * x) * sz;
+    m[10] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+    m[11] = 0.0f;
+    m[12] = components_[TX][i];
+    m[13] = components_[TY][i];
+    m[14] = components_[TZ][i];
+    m[15] = 1.0f;
+  }
+}
+
+#if defined(TRANSFORM_X86)
+
+inline size_t TransformArray::composeSSE(size_t first, size_t last, char* out, size_t stride) const {
+  const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+  size_t i = first;
+  for (; i + 4 <= last; i += 4, out += 4 * stride) {
+    const __m128 x = _mm_loadu_ps(&components_[QX][i]), y = _mm_loadu_ps(&components_[QY][i]);
+    const __m128 z = _mm_loadu_ps(&components_[QZ][i]), w = _mm_loadu_ps(&components_[QW][i]);
+    const __m128 sx = _mm_loadu_ps(&components_[SX][i]), sy = _mm_loadu_ps(&components_[SY][i]);
+    const __m128 sz = _mm_loadu_ps(&components_[SZ][i]);
+    const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    // one register per matrix element across the four objects, transposed into four columns each
+    __m128 columns[4][4] = {
+      {_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+       _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+       _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx), zero},
+      {_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+       _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+       _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy), zero},
+      {_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+       _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+       _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz), zero},
+      {_mm_loadu_ps(&components_[TX][i]), _mm_loadu_ps(&components_[TY][i]),
+       _mm_loadu_ps(&components_[TZ][i]), one}
+    };
+    for (int c = 0; c < 4; c++) {
+      _MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+      for (int k = 0; k < 4; k++)
+        _mm_storeu_ps(reinterpret_cast<float*>(out + k * stride) + 4 * c, columns[c][k]);
+    }
+  }
+  return i;
+}
+
+inline size_t TransformArray::composeAVX2(size_t first, size_t last, char* out, size_t stride) const {
+  const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+  size_t i = first;
+  for (; i + 8 <= last; i += 8, out += 8 * stride) {
+    const __m256 x = _mm256_loadu_ps(&components_[QX][i]), y = _mm256_loadu_ps(&components_[QY][i]);
+    const __m256 z = _mm256_loadu_ps(&components_[QZ][i]), w = _mm256_loadu_ps(&components_[QW][i]);
+    const __m256 sx = _mm256_loadu_ps(&components_[SX][i]), sy = _mm256_loadu_ps(&components_[SY][i]);
+    const __m256 sz = _mm256_loadu_ps(&components_[SZ][i]);
+    const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+    const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+    const __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+    const __m256 elements[4][4] = {
+      {_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+       _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+       _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx), zero},
+      {_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+       _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+       _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy), zero},
+      {_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+       _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+       _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz), zero},
+      {_mm256_loadu_ps(&components_[TX][i]), _mm256_loadu_ps(&components_[TY][i]),
+       _mm256_loadu_ps(&components_[TZ][i]), one}
+    };
+
+    // transpose every column to one vec4 per object, object k in the low half and k + 4 in the high half
+    __m256 columns[4][4];
+    for (int c = 0; c < 4; c++) {
+      const __m256 t0 = _mm256_unpacklo_ps(elements[c][0], elements[c][1]);
+      const __m256 t1 = _mm256_unpackhi_ps(elements[c][0], elements[c][1]);
+      const __m256 t2 = _mm256_unpacklo_ps(elements[c][2], elements[c][3]);
+      const __m256 t3 = _mm256_unpackhi_ps(elements[c][2], elements[c][3]);
+      columns[c][0] = _mm256_shuffle_ps(t0, t2, 0x44);
+      columns[c][1] = _mm256_shuffle_ps(t0, t2, 0xee);
+      columns[c][2] = _mm256_shuffle_ps(t1, t3, 0x44);
+      columns[c][3] = _mm256_shuffle_ps(t1, t3, 0xee);
+    }
+    // two columns per 32 byte store
+    for (int k = 0; k < 4; k++) {
+      float* low = reinterpret_cast<float*>(out + k * stride);
+      float* high = reinterpret_cast<float*>(out + (k + 4) * stride);
+      _mm256_storeu_ps(low, _mm256_permute2f128_ps(columns[0][k], columns[1][k], 0x20));
+      _mm256_storeu_ps(low + 8, _mm256_permute2f128_ps(columns[2][k], columns[3][k], 0x20));
+      _mm256_storeu_ps(high, _mm256_permute2f128_ps(columns[0][k], columns[1][k], 0x31));
+      _mm256_storeu_ps(high + 8, _mm256_permute2f128_ps(columns[2][k], columns[3][k], 0x31));
+    }
+  }
+  // the compiler only adds this when optimizing, and SSE code after dirty upper halves is slow
+  _mm256_zeroupper();
+  return i;
+}
+
+#endif
+
+#endif
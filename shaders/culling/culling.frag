@@ -0,0 +1,12 @@
+#version 420 core
+
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D texture1;
+uniform sampler2D texture2;
+
+void main() {
+ FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.8);
+}
@@ -0,0 +1,13 @@
+#version 420 core
+
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D texture1;
+uniform sampler2D texture2;
+uniform vec4 tint;
+
+void main() {
+ FragColor = tint * mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.5);
+}
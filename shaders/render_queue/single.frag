@@ -0,0 +1,12 @@
+#version 420 core
+
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D texture1;
+uniform vec4 tint;
+
+void main() {
+ FragColor = tint * texture(texture1, TexCoord);
+}
@@ -0,0 +1,16 @@
+#version 420 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in mat4 aModel;
+
+out vec2 TexCoord;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float cubeScale;
+
+void main() {
+   gl_Position = projection * view * aModel * vec4(cubeScale * aPos, 1.0);
+   TexCoord = aTexCoord;
+}
@@ -0,0 +1,307 @@
+// Runs the basic samples headless for a fixed number of frames and collects what each
+// one reports with --stats (startup to the first frame, CPU and GPU frame time
+// percentiles, draw calls per frame) plus the peak resident memory of its process.
+// The results go to a JSON file; given a baseline written by an earlier run, every
+// metric that got worse by more than the threshold, or rose above a baseline of 0, is
+// reported and the exit code is 1.
+//
+//   Bench [--frames N] [--runs N] [--output FILE] [--baseline FILE] [--threshold PERCENT] [SAMPLE...]
+//
+// With several runs every metric is the median of the runs. Without sample names all
+// of them run.
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+struct Sample {
+  const char* name;
+  const char* path;   // where CMake built it
+};
+
+const Sample SAMPLES[] = {
+  {"HelloOpenGL", HELLO_OPENGL_PATH},
+  {"Shaders", SHADERS_PATH},
+  {"Textures", TEXTURES_PATH},
+  {"Transformations", TRANSFORMATIONS_PATH},
+  {"CoordinateSystems", COORDINATE_SYSTEMS_PATH},
+};
+
+// metrics in the order they were read, nested objects flattened to "outer.inner"
+typedef std::vector<std::pair<std::string, double>> Metrics;
+
+
+const double* find(const Metrics& metrics, const std::string& name) {
+  for (const auto& metric : metrics)
+    if (metric.first == name)
+      return &metric.second;
+  return nullptr;
+}
+
+
+// just enough JSON for the files this program and --stats write: objects of numbers
+class JsonReader {
+public:
+  explicit JsonReader(const std::string& text) : text_(text) {}
+
+  bool read(Metrics& metrics) { return readObject("", metrics) && (skipSpace(), pos_ == text_.size()); }
+
+private:
+  void skipSpace() {
+    while (pos_ < text_.size() && std::isspace((unsigned char)text_[pos_]))
+      pos_++;
+  }
+  bool expect(char c) {
+    skipSpace();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      pos_++;
+      return true;
+    }
+    return false;
+  }
+  bool readString(std::string& value) {
+    if (!expect('"'))
+      return false;
+    const size_t end = text_.find('"', pos_);
+    if (end == std::string::npos)
+      return false;
+    value = text_.substr(pos_, end - pos_);
+    pos_ = end + 1;
+    return true;
+  }
+  bool readObject(const std::string& prefix, Metrics& metrics) {
+    if (!expect('{'))
+      return false;
+    if (expect('}'))
+      return true;
+    do {
+      std::string key;
+      if (!readString(key) || !expect(':'))
+        return false;
+      skipSpace();
+      const std::string name = prefix.empty() ? key : prefix + "." + key;
+      if (pos_ < text_.size() && text_[pos_] == '{') {
+        if (!readObject(name, metrics))
+          return false;
+        continue;
+      }
+      char* end = nullptr;
+      const double value = std::strtod(text_.c_str() + pos_, &end);
+      if (end == text_.c_str() + pos_)
+        return false;
+      pos_ = end - text_.c_str();
+      metrics.emplace_back(name, value);
+    } while (expect(','));
+    return expect('}');
+  }
+
+  const std::string& text_;
+  size_t pos_ = 0;
+};
+
+
+bool readJson(const std::string& path, Metrics& metrics) {
+  std::ifstream file(path);
+  if (!file)
+    return false;
+  std::stringstream text;
+  text << file.rdbuf();
+  return JsonReader(text.str()).read(metrics);
+}
+
+
+// one headless run of the sample, its --stats and the peak memory and wall time of its process
+bool runSample(const Sample& sample, int frames, Metrics& metrics) {
+  char stats_path[] = "/tmp/bench_stats_XXXXXX";
+  const int stats_file = mkstemp(stats_path);
+  if (stats_file < 0)
+    return false;
+  close(stats_file);
+
+  const std::string frame_count = std::to_string(frames);
+  const char* const arguments[] = {sample.path, "--headless", "--frames", frame_count.c_str(),
+                                   "--stats", stats_path, nullptr};
+  const auto start = std::chrono::steady_clock::now();
+  const pid_t pid = fork();
+  if (pid == 0) {
+    // the samples' own reports would drown the table
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    execv(sample.path, const_cast<char* const*>(arguments));
+    std::perror(sample.path);
+    _exit(127);
+  }
+  int status = 0;
+  rusage usage = {};
+  const bool exited = pid > 0 && wait4(pid, &status, 0, &usage) == pid && WIFEXITED(status) &&
+                      WEXITSTATUS(status) == 0;
+  const double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  const bool read = exited && readJson(stats_path, metrics);
+  unlink(stats_path);
+  if (!read)
+    return false;
+  metrics.emplace_back("max_rss_kb", (double)usage.ru_maxrss);
+  metrics.emplace_back("wall_ms", wall_ms);
+  return true;
+}
+
+
+double median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  const size_t middle = values.size() / 2;
+  return values.size() % 2 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+}
+
+
+void writeJson(std::ostream& out, int frames, int runs, const std::vector<std::pair<std::string, Metrics>>& results) {
+  out << "{\n  \"frames\": " << frames << ",\n  \"runs\": " << runs << ",\n  \"samples\": {";
+  for (size_t i = 0; i < results.size(); i++) {
+    out << (i ? "," : "") << "\n    \"" << results[i].first << "\": {";
+    const Metrics& metrics = results[i].second;
+    for (size_t j = 0; j < metrics.size(); j++)
+      out << (j ? "," : "") << "\n      \"" << metrics[j].first << "\": " << metrics[j].second;
+    out << "\n    }";
+  }
+  out << "\n  }\n}\n";
+}
+
+
+int main(int argc, char** argv) {
+  int frames = 300;
+  int runs = 1;
+  double threshold = 10.0;
+  std::string output = "bench.json";
+  std::string baseline_path;
+  std::vector<const Sample*> samples;
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (argument == "--frames" && has_value)
+      frames = std::max(2, std::atoi(argv[++i]));
+    else if (argument == "--runs" && has_value)
+      runs = std::max(1, std::atoi(argv[++i]));
+    else if (argument == "--output" && has_value)
+      output = argv[++i];
+    else if (argument == "--baseline" && has_value)
+      baseline_path = argv[++i];
+    else if (argument == "--threshold" && has_value)
+      threshold = std::atof(argv[++i]);
+    else {
+      const auto sample = std::find_if(std::begin(SAMPLES), std::end(SAMPLES),
+                                       [&](const Sample& s) { return argument == s.name; });
+      if (sample == std::end(SAMPLES)) {
+        std::cout << "Unknown argument or sample " << argument << std::endl;
+        return 2;
+      }
+      samples.push_back(sample);
+    }
+  }
+  if (samples.empty())
+    for (const Sample& sample : SAMPLES)
+      samples.push_back(&sample);
+
+  Metrics baseline;
+  if (!baseline_path.empty() && !readJson(baseline_path, baseline)) {
+    std::cout << "Failed to read the baseline " << baseline_path << std::endl;
+    return 2;
+  }
+
+  std::cout << frames << " frames headless, median of " << runs << " run(s)" << std::endl;
+  std::cout << std::left << std::setw(20) << "sample" << std::right << std::setw(12) << "startup ms"
+            << std::setw(12) << "cpu p50" << std::setw(12) << "cpu p99" << std::setw(12) << "gpu p50"
+            << std::setw(12) << "gpu p99" << std::setw(8) << "draws" << std::setw(12) << "rss MB" << std::endl;
+
+  std::vector<std::pair<std::string, Metrics>> results;
+  bool failed = false;
+  for (const Sample* sample : samples) {
+    std::vector<Metrics> run_metrics(runs);
+    bool ran = true;
+    for (int run = 0; run < runs && ran; run++)
+      ran = runSample(*sample, frames, run_metrics[run]);
+    if (!ran) {
+      std::cout << std::left << std::setw(20) << sample->name << "failed to run" << std::endl;
+      failed = true;
+      continue;
+    }
+
+    Metrics metrics;
+    for (const auto& metric : run_metrics[0]) {
+      std::vector<double> values;
+      for (const Metrics& run : run_metrics)
+        if (const double* value = find(run, metric.first))
+          values.push_back(*value);
+      metrics.emplace_back(metric.first, median(values));
+    }
+    auto value = [&metrics](const char* name) {
+      const double* value = find(metrics, name);
+      return value ? *value : 0.0;
+    };
+    std::cout << std::left << std::setw(20) << sample->name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << value("startup_ms") << std::setw(12) << value("cpu_frame_ms_p50")
+              << std::setw(12) << value("cpu_frame_ms_p99") << std::setw(12) << value("gpu_frame_ms_p50")
+              << std::setw(12) << value("gpu_frame_ms_p99") << std::setw(8) << std::setprecision(0)
+              << value("draw_calls_per_frame") << std::setw(12) << std::setprecision(1)
+              << value("max_rss_kb") / 1024.0 << std::defaultfloat << std::setprecision(6) << std::endl;
+    results.emplace_back(sample->name, metrics);
+  }
+
+  std::ofstream file(output);
+  if (!file) {
+    std::cout << "Failed to write " << output << std::endl;
+    return 2;
+  }
+  writeJson(file, frames, runs, results);
+  std::cout << "Results written to " << output << std::endl;
+
+  // everything measured is better lower; frames and wall time depend on the run, not the code.
+  // Metrics that should stay 0, the GL objects created per frame and the GL debug
+  // messages, have no percentage to grow by, any increase from 0 counts
+  int regressions = 0;
+  if (!baseline.empty()) {
+    for (const auto& result : results) {
+      for (const auto& metric : result.second) {
+        if (metric.first == "frames" || metric.first == "wall_ms")
+          continue;
+        const double* before = find(baseline, "samples." + result.first + "." + metric.first);
+        if (!before)
+          continue;
+        if (*before <= 0.0) {
+          if (metric.second > 0.0) {
+            std::cout << "REGRESSION " << result.first << " " << metric.first << ": " << *before << " -> "
+                      << metric.second << std::endl;
+            regressions++;
+          }
+          continue;
+        }
+        const double change = 100.0 * (metric.second - *before) / *before;
+        if (change > threshold) {
+          std::cout << "REGRESSION " << result.first << " " << metric.first << ": " << *before << " -> "
+                    << metric.second << " (+" << std::fixed << std::setprecision(1) << change << "%)"
+                    << std::defaultfloat << std::setprecision(6) << std::endl;
+          regressions++;
+        }
+      }
+    }
+    std::cout << regressions << " regression(s) over " << threshold << "% against " << baseline_path << std::endl;
+  }
+  if (failed)
+    return 2;
+  return regressions ? 1 : 0;
+}
@@ -14,7 +14,15 @@
 #include <thirdparty/stb_image.h>
 
 #include "Config.h"
+#include "camera.h"
+#include "context.h"
+#include "context_tools.h"
+#include "fast_math.h"
+#include "gl_objects.h"
+#include "gl_state.h"
+#include "mesh.h"
 #include "shader.h"
+#include "trace.h"
 
 
 namespace fs = std::experimental::filesystem;
@@ -22,47 +30,28 @@ namespace fs = std::experimental::filesystem;
 const fs::path shader_dir = fs::path(SHADER_DIR)/"coordinate_systems";
 const fs::path texture_dir(TEXTURE_DIR);
 
+Camera camera;
+
 void resizeWindowCallback(GLFWwindow* window, int width, int height) {
-  const int w = std::min(width, 4*height/3);
-  const int h = std::min(height, 3*width/4);
-  glViewport(0, 0, w, h);
+  glViewport(0, 0, width, height);
+  camera.setViewport(width, height);
 }
 
-void processKeyboard(GLFWwindow* window) {
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-    glfwSetWindowShouldClose(window, true);
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
 }
 
 
-int main() {
-  /**
-   * GLFW Initialize
-   */
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-//  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);  // Debugging
-
-  /**
-   * GLFW window creation
-   */
-  GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
-    return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, resizeWindowCallback);
-
+int main(int argc, char** argv) {
   /**
-   * GLEW load OpenGL function pointers
+   * Create the window and its context, or an offscreen one with --headless
    */
-  if (glewInit() != GLEW_OK) {
-    std::cout << "Failed to initialize GLEW" << std::endl;
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv));
+  if (!context.valid())
     return -1;
-  }
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
 
   /**
    * Build and compile shader program
@@ -117,24 +106,17 @@ int main() {
       -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
       -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
   };
-  unsigned int indices[] = {
-    0, 1, 3,  // first triangle
-    1, 2, 3   // second triangle
-  };
+  // weld the corners the faces share, 36 vertices become 16 plus indices
+  const Mesh cube = indexMesh(reinterpret_cast<const Vertex*>(vertices), sizeof(vertices) / sizeof(Vertex));
 
-  unsigned int VBO;   // vertex buffer object (vertices in GPU)
-  unsigned int VAO;   // vertex array object (stores vertex attribute calls)
-//  unsigned int EBO;   // element buffer object
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-//  glGenBuffers(1, &EBO);
+  GLBuffer VBO;       // vertex buffer object (vertices in GPU)
+  GLVertexArray VAO;  // vertex array object (stores vertex attribute calls)
+  GLBuffer EBO;       // element buffer object
 
   glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  VBO.data(GL_ARRAY_BUFFER, cube.vertices.size() * sizeof(Vertex), cube.vertices.data(), GL_STATIC_DRAW);
 
-//  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-//  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  EBO.data(GL_ELEMENT_ARRAY_BUFFER, cube.indices.size() * sizeof(uint32_t), cube.indices.data(), GL_STATIC_DRAW);
 
   // position attribute
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
@@ -148,9 +130,9 @@ int main() {
   /**
    * Set up texture data
    */
-  unsigned int texture1, texture2;
-  glGenTextures(1, &texture1);
+  GLTexture texture1, texture2;
   glBindTexture(GL_TEXTURE_2D, texture1);
+  texture1.label("container.jpg");
   // set the texture wrapping/filteringoptions
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -160,19 +142,22 @@ int main() {
   // load and generate the texture
   int width, height, nrChannels;
   stbi_set_flip_vertically_on_load(true);
+  TRACE_ZONE_BEGIN(decode_container, "decode texture");
   unsigned char *data = stbi_load((texture_dir/"container.jpg").c_str(),
                                   &width, &height, &nrChannels, 0);
+  TRACE_ZONE_END(decode_container);
   if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    TRACE_ZONE("upload texture");
+    texture1.image2D(0, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+    texture1.generateMipmap();
   }
   else {
     std::cerr << "Failed to load texture\n";
   }
   stbi_image_free(data);
 
-  glGenTextures(1, &texture2);
   glBindTexture(GL_TEXTURE_2D, texture2);
+  texture2.label("awesomeface.png");
   // set the texture wrapping/filteringoptions
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -180,10 +165,13 @@ int main() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+  TRACE_ZONE_BEGIN(decode_face, "decode texture");
   data = stbi_load((texture_dir/"awesomeface.png").c_str(), &width, &height, &nrChannels, 0);
+  TRACE_ZONE_END(decode_face);
   if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    TRACE_ZONE("upload texture");
+    texture2.image2D(0, GL_RGBA, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    texture2.generateMipmap();
   }
   else {
     std::cerr << "Failed to load texture\n";
@@ -194,46 +182,48 @@ int main() {
   shaderProgram.setInt("texture1", 1);
   shaderProgram.setInt("texture2", 0);
 
-  glEnable(GL_DEPTH_TEST);
+  // the render loop binds through the cache, which drops what is still bound from the last frame
+  GLState state_cache;
+  state_cache.enable(GL_DEPTH_TEST);
 
-  while(!glfwWindowShouldClose(window)) {
-    processKeyboard(window);
+  camera.setView(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f)));
+  uint64_t uploaded_camera = 0;
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    TRACE_ZONE_BEGIN(submit, "submit");
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    state_cache.bindTexture(0, GL_TEXTURE_2D, texture1);
+    state_cache.bindTexture(1, GL_TEXTURE_2D, texture2);
 
     // create transformations
-    glm::mat4 model, view, projection;
-    model = view = projection = glm::mat4(1.0f);
-    model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
-    projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 model = glm::mat4(1.0f);
+    model = rotateX(model, (float)context.time() * glm::radians(50.0f));
+    context.invalidate();
 
-    shaderProgram.use();
+    state_cache.useProgram(shaderProgram.ID);
     unsigned int modelLoc = glGetUniformLocation(shaderProgram.ID, "model");
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    unsigned int viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    unsigned int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // the camera only changes when the window is resized
+    if (camera.version() != uploaded_camera) {
+      unsigned int viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
+      glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(camera.view()));
+      unsigned int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
+      glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(camera.projection()));
+      uploaded_camera = camera.version();
+    }
 
     // render
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    state_cache.bindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, (GLsizei)cube.indices.size(), GL_UNSIGNED_INT, 0);
+    context.countDraws();
+    TRACE_ZONE_END(submit);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    context.swapBuffers();
+    context.pollEvents();
   }
 
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-//  glDeleteBuffers(1, &EBO);
-
-  glfwTerminate();
   return 0;
 }
@@ -0,0 +1,408 @@
+// Many cubes frustum culled through a bounding volume hierarchy on the CPU
+// or by a compute shader feeding indirect draws (G toggles), the latter also
+// occlusion culled against last frame's depth (O cycles off/previous frame/reprojected).
+// T adds the GPU time of each pass to the report.
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+#include <thirdparty/glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include<experimental/filesystem>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <thirdparty/stb_image.h>
+
+#include "Config.h"
+#include "bvh.h"
+#include "context.h"
+#include "context_tools.h"
+#include "depth_pyramid.h"
+#include "gpu_culling.h"
+#include "gpu_profiler.h"
+#include "shader.h"
+#include "texture.h"
+#include "trace.h"
+
+
+namespace fs = std::experimental::filesystem;
+
+const fs::path shader_dir = fs::path(SHADER_DIR)/"culling";
+const fs::path texture_dir(TEXTURE_DIR);
+
+const int GRID_SIZE = 64;         // cubes along each side of the grid
+const int GRID_LAYERS = 2;        // stacked grids
+const float GRID_SPACING = 2.0f;  // distance between neighbouring cubes
+
+bool gpu_culling = true;
+int occlusion_mode = 2;  // 0 off, else DepthPyramid::Mode + 1
+const char* occlusion_names[] = {"off", "previous frame", "reprojected"};
+bool report_gpu_times = false;
+
+// size of the 4:3 viewport, the scene renders into an offscreen target of that size
+int viewport_width = 800;
+int viewport_height = 600;
+
+void resizeWindowCallback(GLFWwindow* window, int width, int height) {
+  viewport_width = std::min(width, 4*height/3);
+  viewport_height = std::min(height, 3*width/4);
+  glViewport(0, 0, viewport_width, viewport_height);
+}
+
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+    gpu_culling = !gpu_culling;
+    std::cout << (gpu_culling ? "GPU" : "CPU") << " culling" << std::endl;
+  }
+  if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+    occlusion_mode = (occlusion_mode + 1) % 3;
+    std::cout << "occlusion culling " << occlusion_names[occlusion_mode] << std::endl;
+  }
+  if (key == GLFW_KEY_T && action == GLFW_PRESS)
+    report_gpu_times = !report_gpu_times;
+}
+
+// cube mesh plus a model matrix attribute sourced from instanceVBO
+unsigned int createVertexArray(unsigned int VBO, unsigned int EBO, unsigned int instanceVBO) {
+  unsigned int VAO;
+  glGenVertexArrays(1, &VAO);
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+  // position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // texture coord attribute
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  // model matrix attribute, one column per location, advanced once per instance
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  for (int column = 0; column < 4; column++) {
+    glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void*)(column * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(2 + column);
+    glVertexAttribDivisor(2 + column, 1);
+  }
+  return VAO;
+}
+
+// (re)allocate the offscreen color and depth, the depth texture feeds the depth pyramid
+void allocateRenderTarget(unsigned int colorRBO, unsigned int depthTexture, int width, int height) {
+  glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+
+int main(int argc, char** argv) {
+  /**
+   * Create the window and its context, or an offscreen one with --headless
+   */
+  ContextOptions options = parseContextOptions(argc, argv);
+  options.minor_version = 3;  // compute shaders
+  Context context(800, 600, "LearnOpenGL", options);
+  if (!context.valid())
+    return -1;
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
+  context.setKeyCallback(keyCallback);
+  int framebuffer_width, framebuffer_height;
+  context.framebufferSize(&framebuffer_width, &framebuffer_height);
+
+  /**
+   * Build and compile shader program
+   */
+  const fs::path vert_shader_path = shader_dir/"culling.vert";
+  const fs::path frag_shader_path = shader_dir/"culling.frag";
+  ShaderProgram shaderProgram(vert_shader_path.c_str(), frag_shader_path.c_str());
+
+  /**
+   * Set up vertex data and buffers and configure vertex attribues
+   */
+  float vertices[] = {
+      // back
+      -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+       0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+       0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+      -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+      // front
+      -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+       0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+       0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+      -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+      // left
+      -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+      -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+      -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+      -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+      // right
+       0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+       0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+       0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+       0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+      // bottom
+      -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+       0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
+       0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+      -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+      // top
+      -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+       0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+       0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+      -0.5f,  0.5f,  0.5f,  0.0f, 0.0f
+  };
+  unsigned int indices[] = {
+     0,  1,  2,   2,  3,  0,
+     4,  5,  6,   6,  7,  4,
+     8,  9, 10,  10, 11,  8,
+    12, 13, 14,  14, 15, 12,
+    16, 17, 18,  18, 19, 16,
+    20, 21, 22,  22, 23, 20
+  };
+
+  unsigned int VBO;           // vertex buffer object (vertices in GPU)
+  unsigned int EBO;           // element buffer object
+  unsigned int instanceVBO;   // per instance model matrices of the CPU culled objects
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  glGenBuffers(1, &instanceVBO);
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+  // the element buffer binding is VAO state, upload the indices with one bound
+  unsigned int VAO = createVertexArray(VBO, EBO, instanceVBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  /**
+   * Set up texture data
+   */
+  stbi_set_flip_vertically_on_load(true);
+  GLTexture texture1 = loadTexture(texture_dir/"container.jpg", GL_RGB);
+  GLTexture texture2 = loadTexture(texture_dir/"awesomeface.png", GL_RGBA);
+
+  shaderProgram.use();
+  shaderProgram.setInt("texture1", 1);
+  shaderProgram.setInt("texture2", 0);
+
+  /**
+   * Set up the scene: a randomly rotated cube per grid cell, every fourth one bobbing.
+   * The bobbing cubes come first so their per frame upload is one contiguous range.
+   */
+  const AABB cube_bounds(glm::vec3(-0.5f), glm::vec3(0.5f));
+  const int object_count = GRID_SIZE * GRID_SIZE * GRID_LAYERS;
+  const int moving_count = object_count / 4;
+  std::vector<glm::mat4> models(object_count);
+  std::vector<AABB> bounds(object_count);
+  std::vector<float> heights(object_count), phases(object_count);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> random(0.0f, 1.0f);
+  for (int i = 0; i < object_count; i++) {
+    const int cell = (i % moving_count) * 4 + i / moving_count;
+    const int x = cell % GRID_SIZE;
+    const int z = (cell / GRID_SIZE) % GRID_SIZE;
+    const int layer = cell / (GRID_SIZE * GRID_SIZE);
+    const glm::vec3 position = GRID_SPACING * glm::vec3(x - GRID_SIZE / 2, 2 * layer, z - GRID_SIZE / 2);
+    const glm::vec3 axis = glm::normalize(glm::vec3(random(rng), random(rng), random(rng)) + 0.01f);
+    models[i] = glm::rotate(glm::translate(glm::mat4(1.0f), position), random(rng) * 6.28f, axis);
+    bounds[i] = transformAABB(models[i], cube_bounds);
+    heights[i] = position.y;
+    phases[i] = random(rng) * 6.28f;
+  }
+  BVH bvh;
+  bvh.build(bounds);
+
+  std::vector<uint32_t> visible;
+  std::vector<glm::mat4> instances;
+
+  GpuCulling culling;
+  culling.setDrawGroups({GpuCulling::DrawGroup{36, 0, 0, (GLuint)object_count}});
+  std::vector<GpuCulling::Instance> gpu_instances(object_count);
+  for (int i = 0; i < object_count; i++)
+    gpu_instances[i] = GpuCulling::Instance{models[i], bounds[i].min, 0, bounds[i].max, 0};
+  culling.setInstances(gpu_instances.data(), object_count);
+  unsigned int gpuVAO = createVertexArray(VBO, EBO, culling.visibleBuffer());
+
+  /**
+   * Set up the offscreen render target and the depth pyramid built from its depth
+   */
+  resizeWindowCallback(context.window(), framebuffer_width, framebuffer_height);
+  int target_width = viewport_width, target_height = viewport_height;
+  unsigned int FBO, colorRBO, depthTexture;
+  glGenFramebuffers(1, &FBO);
+  glGenRenderbuffers(1, &colorRBO);
+  glGenTextures(1, &depthTexture);
+  allocateRenderTarget(colorRBO, depthTexture, target_width, target_height);
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+
+  DepthPyramid pyramid(target_width, target_height);
+  glm::mat4 depth_view_projection = glm::mat4(1.0f);  // camera the depth texture was rendered with
+  bool depth_valid = false;
+
+  glEnable(GL_DEPTH_TEST);
+
+  GpuProfiler profiler;
+  double last_report = context.time();
+  int frames = 0, rebuilds = 0;
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    const float time = (float)context.time();
+    profiler.beginFrame();
+    TRACE_ZONE_BEGIN(update, "update");
+
+    if (viewport_width != target_width || viewport_height != target_height) {
+      target_width = viewport_width;
+      target_height = viewport_height;
+      allocateRenderTarget(colorRBO, depthTexture, target_width, target_height);
+      pyramid.resize(target_width, target_height);
+      depth_valid = false;
+    }
+
+    // move the bobbing cubes and refit the hierarchy around them,
+    // rebuilding in the background once the refitted tree got too loose
+    for (int i = 0; i < moving_count; i++) {
+      models[i][3].y = heights[i] + 3.0f * std::sin(0.5f * time + phases[i]);
+      bounds[i] = transformAABB(models[i], cube_bounds);
+      bvh.setBounds(i, bounds[i]);
+    }
+
+    // fly around inside the grid looking along the path
+    const float angle = 0.1f * time;
+    const glm::vec3 eye(24.0f * std::cos(angle), 6.0f, 24.0f * std::sin(angle));
+    const glm::vec3 forward(-std::sin(angle), -0.15f, std::cos(angle));
+    const glm::mat4 view = glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    TRACE_ZONE_END(update);
+
+    // cull
+    TRACE_ZONE_BEGIN(cull, "cull");
+    if (gpu_culling) {
+      GpuProfiler::Scope cull_scope(profiler, "cull");
+      for (int i = 0; i < moving_count; i++)
+        gpu_instances[i] = GpuCulling::Instance{models[i], bounds[i].min, 0, bounds[i].max, 0};
+      {
+        GpuProfiler::Scope scope(profiler, "upload instances");
+        culling.updateInstances(gpu_instances.data(), 0, moving_count);
+      }
+      if (occlusion_mode && depth_valid) {
+        pyramid.setMode(DepthPyramid::Mode(occlusion_mode - 1));
+        {
+          GpuProfiler::Scope scope(profiler, "depth pyramid");
+          pyramid.build(depthTexture, depth_view_projection, projection * view);
+        }
+        GpuProfiler::Scope scope(profiler, "frustum and occlusion");
+        culling.cull(projection * view, &pyramid);
+      }
+      else {
+        GpuProfiler::Scope scope(profiler, "frustum");
+        culling.cull(projection * view);
+      }
+    }
+    else {
+      bvh.refit();
+      if (bvh.pollRebuild())
+        rebuilds++;
+      else if (bvh.needsRebuild())
+        bvh.rebuildAsync();
+
+      visible.clear();
+      bvh.queryFrustum(Frustum::fromMatrix(projection * view), visible);
+      instances.resize(visible.size());
+      for (size_t i = 0; i < visible.size(); i++)
+        instances[i] = models[visible[i]];
+    }
+
+    TRACE_ZONE_END(cull);
+    TRACE_ZONE_BEGIN(submit, "submit");
+    profiler.begin("scene");
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, texture2);
+
+    shaderProgram.use();
+    unsigned int viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    unsigned int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+    // render
+    if (gpu_culling) {
+      glBindVertexArray(gpuVAO);
+      culling.draw();
+    }
+    else {
+      glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+      // orphan last frame's storage instead of waiting for the GPU to finish with it
+      glBufferData(GL_ARRAY_BUFFER, object_count * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::mat4), instances.data());
+      glBindVertexArray(VAO);
+      glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, (GLsizei)instances.size());
+    }
+    profiler.end();
+    depth_view_projection = projection * view;
+    depth_valid = true;
+
+    // show the offscreen color
+    profiler.begin("blit");
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context.framebuffer());
+    glBlitFramebuffer(0, 0, target_width, target_height, 0, 0, target_width, target_height,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    profiler.end();
+    profiler.endFrame();
+    TRACE_ZONE_END(submit);
+
+    context.swapBuffers();
+    context.pollEvents();
+
+    frames++;
+    if (context.time() - last_report >= 1.0) {
+      if (gpu_culling)
+        std::cout << frames << " fps, " << culling.stats().visible << "/" << culling.stats().tested
+                  << " objects visible, " << culling.stats().occluded << " occluded (GPU)" << std::endl;
+      else
+        std::cout << frames << " fps, " << visible.size() << "/" << object_count << " objects visible, "
+                  << bvh.nodeCount() << " nodes, " << rebuilds << " rebuilds" << std::endl;
+      if (report_gpu_times)
+        profiler.report(std::cout);
+      last_report = context.time();
+      frames = 0;
+    }
+  }
+
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteRenderbuffers(1, &colorRBO);
+  glDeleteTextures(1, &depthTexture);
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteVertexArrays(1, &gpuVAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  glDeleteBuffers(1, &instanceVBO);
+
+  return 0;
+}
@@ -0,0 +1,214 @@
+// Renders the basic samples headless and compares their last frame against the
+// reference images in golden/. Every sample runs a fixed number of frames with
+// --fixed-step, so the animated ones stop at the same point in their animation on
+// every run, and saves that frame with --capture. Pixels are compared by their
+// perceived difference, the YIQ color distance pixelmatch uses, so small shifts in
+// color from another rasterizer pass while anything that changes what is drawn
+// does not. A sample fails when more than the tolerated share of its pixels differ,
+// and a diff image marks them in red on the faded reference.
+//
+//   Golden [--frames N] [--threshold T] [--tolerance PERCENT] [--output DIR] [--update] [SAMPLE...]
+//
+// --update writes the new frames over the reference images instead of comparing.
+// The references were rendered with Mesa's llvmpipe. Without sample names all of
+// them run. The samples run with --gl-debug and only their standard output is
+// silenced, so GL errors and the driver's performance warnings show up here.
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <thirdparty/stb_image.h>
+
+#include "Config.h"
+#include "png.h"
+
+
+struct Sample {
+  const char* name;
+  const char* path;   // where CMake built it
+};
+
+const Sample SAMPLES[] = {
+  {"HelloOpenGL", HELLO_OPENGL_PATH},
+  {"Shaders", SHADERS_PATH},
+  {"Textures", TEXTURES_PATH},
+  {"Transformations", TRANSFORMATIONS_PATH},
+  {"CoordinateSystems", COORDINATE_SYSTEMS_PATH},
+};
+
+struct Image {
+  int width = 0, height = 0;
+  std::vector<uint8_t> rgb;
+};
+
+
+bool readImage(const std::string& path, Image& image) {
+  int channels = 0;
+  stbi_uc* pixels = stbi_load(path.c_str(), &image.width, &image.height, &channels, 3);
+  if (!pixels)
+    return false;
+  image.rgb.assign(pixels, pixels + (size_t)image.width * image.height * 3);
+  stbi_image_free(pixels);
+  return true;
+}
+
+
+// one headless run of the sample that saves its last frame to path
+bool runSample(const Sample& sample, int frames, const std::string& path) {
+  const std::string frame_count = std::to_string(frames);
+  const char* const arguments[] = {sample.path, "--headless", "--frames", frame_count.c_str(),
+                                   "--fixed-step", "--capture", path.c_str(), "--gl-debug", nullptr};
+  unlink(path.c_str());
+  const pid_t pid = fork();
+  if (pid == 0) {
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    execv(sample.path, const_cast<char* const*>(arguments));
+    std::perror(sample.path);
+    _exit(127);
+  }
+  int status = 0;
+  return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+// squared YIQ distance of two colors, 0 to about 35215
+double colorDelta(const uint8_t* a, const uint8_t* b) {
+  const double dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+  const double y = dr * 0.29889531 + dg * 0.58662247 + db * 0.11448223;
+  const double i = dr * 0.59597799 - dg * 0.27417610 - db * 0.32180189;
+  const double q = dr * 0.21147017 - dg * 0.52261711 + db * 0.31114694;
+  return 0.5053 * y * y + 0.299 * i * i + 0.1957 * q * q;
+}
+
+
+// pixels further apart than threshold, 0 to 1 of the largest possible difference; diff shows them
+size_t compare(const Image& expected, const Image& actual, double threshold, Image& diff) {
+  const double max_delta = 35215.0 * threshold * threshold;
+  diff.width = expected.width;
+  diff.height = expected.height;
+  diff.rgb.resize(expected.rgb.size());
+  size_t mismatched = 0;
+  for (size_t i = 0; i < expected.rgb.size(); i += 3) {
+    uint8_t* out = &diff.rgb[i];
+    if (colorDelta(&expected.rgb[i], &actual.rgb[i]) > max_delta) {
+      out[0] = 255;
+      out[1] = out[2] = 0;
+      mismatched++;
+      continue;
+    }
+    // the reference in faded gray, for orientation
+    const double gray = 0.299 * expected.rgb[i] + 0.587 * expected.rgb[i + 1] + 0.114 * expected.rgb[i + 2];
+    out[0] = out[1] = out[2] = (uint8_t)(255 - 0.1 * (255 - gray));
+  }
+  return mismatched;
+}
+
+
+bool copyFile(const std::string& from, const std::string& to) {
+  std::ifstream in(from, std::ios::binary);
+  std::ofstream out(to, std::ios::binary);
+  out << in.rdbuf();
+  return in && out;
+}
+
+
+int main(int argc, char** argv) {
+  int frames = 60;
+  double threshold = 0.1;
+  double tolerance = 0.1;
+  std::string output = "golden_output";
+  bool update = false;
+  std::vector<const Sample*> samples;
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (argument == "--frames" && has_value)
+      frames = std::max(1, std::atoi(argv[++i]));
+    else if (argument == "--threshold" && has_value)
+      threshold = std::atof(argv[++i]);
+    else if (argument == "--tolerance" && has_value)
+      tolerance = std::atof(argv[++i]);
+    else if (argument == "--output" && has_value)
+      output = argv[++i];
+    else if (argument == "--update")
+      update = true;
+    else {
+      const auto sample = std::find_if(std::begin(SAMPLES), std::end(SAMPLES),
+                                       [&](const Sample& s) { return argument == s.name; });
+      if (sample == std::end(SAMPLES)) {
+        std::cout << "Unknown argument or sample " << argument << std::endl;
+        return 2;
+      }
+      samples.push_back(sample);
+    }
+  }
+  if (samples.empty())
+    for (const Sample& sample : SAMPLES)
+      samples.push_back(&sample);
+  mkdir(output.c_str(), 0755);
+
+  int failures = 0;
+  for (const Sample* sample : samples) {
+    const std::string actual_path = output + "/" + sample->name + ".png";
+    const std::string expected_path = std::string(GOLDEN_DIR) + "/" + sample->name + ".png";
+    std::cout << std::left << std::setw(20) << sample->name;
+
+    Image actual;
+    if (!runSample(*sample, frames, actual_path) || !readImage(actual_path, actual)) {
+      std::cout << "failed to run or to capture" << std::endl;
+      failures++;
+      continue;
+    }
+    if (update) {
+      const bool copied = copyFile(actual_path, expected_path);
+      std::cout << (copied ? "updated " : "failed to write ") << expected_path << std::endl;
+      failures += !copied;
+      continue;
+    }
+
+    Image expected;
+    if (!readImage(expected_path, expected)) {
+      std::cout << "no reference image, run with --update to create " << expected_path << std::endl;
+      failures++;
+      continue;
+    }
+    if (expected.width != actual.width || expected.height != actual.height) {
+      std::cout << "FAIL " << actual.width << "x" << actual.height << ", the reference is " << expected.width << "x"
+                << expected.height << std::endl;
+      failures++;
+      continue;
+    }
+
+    Image diff;
+    const size_t mismatched = compare(expected, actual, threshold, diff);
+    const double percent = 100.0 * mismatched / ((size_t)actual.width * actual.height);
+    const bool passed = percent <= tolerance;
+    std::cout << (passed ? "ok   " : "FAIL ") << mismatched << " pixels differ (" << std::fixed
+              << std::setprecision(3) << percent << "%)" << std::defaultfloat << std::setprecision(6);
+    if (!passed) {
+      const std::string diff_path = output + "/" + sample->name + "_diff.png";
+      writePng(diff_path, diff.width, diff.height, 3, diff.rgb.data());
+      std::cout << ", see " << diff_path;
+      failures++;
+    }
+    std::cout << std::endl;
+  }
+
+  if (!update)
+    std::cout << samples.size() - failures << " of " << samples.size() << " match the reference images" << std::endl;
+  return failures ? 1 : 0;
+}
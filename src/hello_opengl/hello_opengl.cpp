@@ -3,6 +3,12 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "context.h"
+#include "context_tools.h"
+#include "gl_objects.h"
+#include "gl_state.h"
+#include "trace.h"
+
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
@@ -21,6 +27,7 @@ const char* fragmentShaderSource = "#version 420 core\n"
 
 
 void compileShader(const char* source, int& shader) {
+  TRACE_ZONE("compile shader");
   glShaderSource(shader, 1, &source, NULL);
   glCompileShader(shader);
   // check for shader compile errors
@@ -39,42 +46,23 @@ void resizeWindowCallback(GLFWwindow* window, int width, int height) {
 }
 
 
-void processKeyboard(GLFWwindow* window) {
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-    glfwSetWindowShouldClose(window, true);
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
 }
 
 
-int main() {
-  /**
-   * GLFW Initialize
-   */
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-//  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);  // Debugging
-  //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-
-  /**
-   * GLFW window creation
-   */
-  GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
-    return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, resizeWindowCallback);
-
+int main(int argc, char** argv) {
   /**
-   * GLEW load OpenGL function pointers
+   * Create the window and its context, or an offscreen one with --headless
    */
-  if (glewInit() != GLEW_OK) {
-    std::cout << "Failed to initialize GLEW" << std::endl;
+  ContextOptions options;
+  options.on_demand = true;
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv, options));
+  if (!context.valid())
     return -1;
-  }
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
 
   /**
    * Build and compile shader program
@@ -84,14 +72,17 @@ int main() {
   compileShader(vertexShaderSource, vertexShader);
   compileShader(fragmentShaderSource, fragmentShader);
   // link shaders
-  int shaderProgram = glCreateProgram();
+  GLProgram shaderProgram;
+  shaderProgram.label("hello_opengl");
   glAttachShader(shaderProgram, vertexShader);
   glAttachShader(shaderProgram, fragmentShader);
+  TRACE_ZONE_BEGIN(link, "link program");
   glLinkProgram(shaderProgram);
   // check for linking errors
   int success;
   char infoLog[512];
   glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+  TRACE_ZONE_END(link);
   if (!success) {
     glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
     std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
@@ -113,19 +104,14 @@ int main() {
     0, 1, 3,  // first triangle
     1, 2, 3   // second triangle
   };
-  unsigned int VBO;   // vertex buffer object (vertices in GPU)
-  unsigned int VAO;   //
-  unsigned int EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  GLBuffer VBO;       // vertex buffer object (vertices in GPU)
+  GLVertexArray VAO;  //
+  GLBuffer EBO;
 
   glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  VBO.data(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  EBO.data(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
   glEnableVertexAttribArray(0);
@@ -136,25 +122,26 @@ int main() {
 
 //  glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);  // not needed because of the callback
 
-  while(!glfwWindowShouldClose(window)) {
-    processKeyboard(window);
+  // the render loop binds through the cache, which drops what is still bound from the last frame
+  GLState state_cache;
+
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    TRACE_ZONE_BEGIN(submit, "submit");
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glUseProgram(shaderProgram);
-    glBindVertexArray(VAO);
+    state_cache.useProgram(shaderProgram);
+    state_cache.bindVertexArray(VAO);
 //    glDrawArrays(GL_TRIANGLES, 0, 6);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    context.countDraws();
+    TRACE_ZONE_END(submit);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    context.swapBuffers();
+    context.pollEvents();
   }
 
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteBuffers(1, &EBO);
-
-  glfwTerminate();
   return 0;
 }
@@ -0,0 +1,318 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <climits>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "trace.h"
+
+
+class JobSystem::Job {
+public:
+  std::function<void()> function;
+  Affinity affinity = Affinity::Any;
+  std::atomic<int> pending{1};        // unfinished dependencies, plus one until submitted
+  std::atomic<bool> done{false};
+  std::mutex mutex;                   // guards continuations and done for addDependency
+  std::vector<JobHandle> continuations;
+  JobHandle self;                     // keeps a scheduled job alive until it ran
+};
+
+// Chase-Lev deque with a fixed power of two capacity, memory orders after
+// Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models"
+class JobSystem::Deque {
+public:
+  static const int64_t CAPACITY = 4096;
+
+  // owner only, false when full
+  bool push(Job* job) {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    const int64_t top = top_.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY)
+      return false;
+    buffer_[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // owner only, newest job first
+  Job* pop() {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Job* job = buffer_[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+      // last job, race the thieves for it
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        job = nullptr;
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  // any thread, oldest job first
+  Job* steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom)
+      return nullptr;
+    Job* job = buffer_[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      return nullptr;
+    return job;
+  }
+
+private:
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Job*> buffer_[CAPACITY];
+};
+
+namespace {
+
+// which system and deque the current thread belongs to
+struct ThreadSlot {
+  const JobSystem* system = nullptr;
+  unsigned index = UINT_MAX;
+};
+thread_local ThreadSlot thread_slot;
+
+}
+
+
+JobSystem::JobSystem(unsigned worker_count, bool pin_threads) {
+  if (worker_count == 0)
+    worker_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  thread_slot = ThreadSlot{this, 0};
+  for (unsigned i = 0; i <= worker_count; i++)
+    deques_.emplace_back(new Deque);
+  for (unsigned i = 1; i <= worker_count; i++)
+    workers_.emplace_back(&JobSystem::workerLoop, this, i, pin_threads);
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    running_ = false;
+  }
+  wake_.notify_all();
+  for (std::thread& worker : workers_)
+    worker.join();
+  if (thread_slot.system == this)
+    thread_slot = ThreadSlot();
+}
+
+JobSystem::JobHandle JobSystem::create(std::function<void()> function, Affinity affinity) {
+  JobHandle job = std::make_shared<Job>();
+  job->function = std::move(function);
+  job->affinity = affinity;
+  return job;
+}
+
+void JobSystem::addDependency(const JobHandle& job, const JobHandle& dependency) {
+  job->pending++;
+  std::lock_guard<std::mutex> lock(dependency->mutex);
+  if (dependency->done)
+    job->pending--;   // cannot reach zero, submit() still holds its count
+  else
+    dependency->continuations.push_back(job);
+}
+
+void JobSystem::submit(const JobHandle& job) {
+  if (job->pending.fetch_sub(1) == 1) {
+    job->self = job;
+    schedule(job.get());
+  }
+}
+
+JobSystem::JobHandle JobSystem::run(std::function<void()> function, const std::vector<JobHandle>& dependencies,
+                                    Affinity affinity) {
+  JobHandle job = create(std::move(function), affinity);
+  for (const JobHandle& dependency : dependencies)
+    addDependency(job, dependency);
+  submit(job);
+  return job;
+}
+
+bool JobSystem::finished(const JobHandle& job) const {
+  return job->done.load(std::memory_order_acquire);
+}
+
+void JobSystem::wait(const JobHandle& job) {
+  const unsigned index = currentThreadIndex();
+  while (!finished(job)) {
+    if (!runOneJob(index))
+      std::this_thread::yield();
+  }
+}
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body, size_t grain) {
+  if (count == 0)
+    return;
+  // a few ranges per thread leave room to balance uneven ranges by stealing
+  if (grain == 0)
+    grain = std::max<size_t>(1, (count + 4 * threadCount() - 1) / (4 * threadCount()));
+  const size_t ranges = (count + grain - 1) / grain;
+  if (ranges == 1) {
+    body(0, count);
+    return;
+  }
+
+  JobHandle all = create([] {});
+  for (size_t range = 1; range < ranges; range++) {
+    const size_t begin = range * grain, end = std::min(begin + grain, count);
+    JobHandle job = create([&body, begin, end] { body(begin, end); });
+    addDependency(all, job);
+    submit(job);
+  }
+  submit(all);
+  body(0, std::min(grain, count));
+  wait(all);
+}
+
+size_t JobSystem::runMainThreadJobs() {
+  size_t count = 0;
+  for (;;) {
+    Job* job;
+    {
+      std::lock_guard<std::mutex> lock(main_mutex_);
+      if (main_queue_.empty())
+        return count;
+      job = main_queue_.front();
+      main_queue_.pop_front();
+    }
+    execute(job);
+    count++;
+  }
+}
+
+void JobSystem::schedule(Job* job) {
+  if (job->affinity == Affinity::MainThread) {
+    std::lock_guard<std::mutex> lock(main_mutex_);
+    main_queue_.push_back(job);
+    return;
+  }
+
+  queued_++;
+  const unsigned index = currentThreadIndex();
+  if (index == UINT_MAX || !deques_[index]->push(job)) {
+    std::lock_guard<std::mutex> lock(injected_mutex_);
+    injected_.push_back(job);
+  }
+  if (sleeping_ > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    wake_.notify_one();
+  }
+}
+
+void JobSystem::execute(Job* job) {
+  {
+    TRACE_ZONE("job");
+    job->function();
+  }
+
+  std::vector<JobHandle> continuations;
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->done.store(true, std::memory_order_release);
+    continuations.swap(job->continuations);
+  }
+  for (const JobHandle& continuation : continuations)
+    submit(continuation);
+  // may destroy the job
+  JobHandle self = std::move(job->self);
+}
+
+JobSystem::Job* JobSystem::findJob(unsigned thread_index) {
+  Job* job = nullptr;
+  if (thread_index != UINT_MAX)
+    job = deques_[thread_index]->pop();
+  if (!job) {
+    std::lock_guard<std::mutex> lock(injected_mutex_);
+    if (!injected_.empty()) {
+      job = injected_.front();
+      injected_.pop_front();
+    }
+  }
+  // steal, starting after ourselves so thieves spread over the victims
+  const size_t deque_count = deques_.size();
+  const size_t start = thread_index == UINT_MAX ? 0 : thread_index + 1;
+  for (size_t i = 0; !job && i < deque_count; i++) {
+    const size_t victim = (start + i) % deque_count;
+    if (victim != thread_index)
+      job = deques_[victim]->steal();
+  }
+  if (job)
+    queued_--;
+  return job;
+}
+
+bool JobSystem::runOneJob(unsigned thread_index) {
+  if (thread_index == 0) {
+    // the main thread also owes the main thread queue, jobs may wait on it
+    Job* job = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(main_mutex_);
+      if (!main_queue_.empty()) {
+        job = main_queue_.front();
+        main_queue_.pop_front();
+      }
+    }
+    if (job) {
+      execute(job);
+      return true;
+    }
+  }
+  if (queued_.load() <= 0)
+    return false;
+  Job* job = findJob(thread_index);
+  if (!job)
+    return false;
+  execute(job);
+  return true;
+}
+
+void JobSystem::workerLoop(unsigned thread_index, bool pin_thread) {
+  thread_slot = ThreadSlot{this, thread_index};
+  TRACE_THREAD_NAME("worker " + std::to_string(thread_index));
+#if defined(__linux__)
+  // leave core 0 to the main thread
+  const unsigned cores = std::thread::hardware_concurrency();
+  if (pin_thread && cores > 1) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(thread_index % cores, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#endif
+
+  while (running_) {
+    if (runOneJob(thread_index))
+      continue;
+    // spin a little before sleeping, jobs often come in bursts
+    for (int spin = 0; spin < 64 && queued_.load() <= 0 && running_; spin++)
+      std::this_thread::yield();
+    if (queued_.load() > 0)
+      continue;
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleeping_++;
+    wake_.wait(lock, [this] { return queued_.load() > 0 || !running_; });
+    sleeping_--;
+  }
+}
+
+unsigned JobSystem::currentThreadIndex() const {
+  return thread_slot.system == this ? thread_slot.index : UINT_MAX;
+}
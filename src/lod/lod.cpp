@@ -0,0 +1,283 @@
+// A field of spheres drawn with levels of detail simplified at startup,
+// each sphere picking its level from its projected error (L toggles),
+// optionally with a reverse Z depth buffer and an infinite far plane (R toggles).
+// Simplification and image decoding run on the job system while the shaders
+// compile, the texture uploads follow on the main thread.
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+#include <thirdparty/glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include<experimental/filesystem>
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <thirdparty/stb_image.h>
+
+#include "Config.h"
+#include "camera.h"
+#include "context.h"
+#include "context_tools.h"
+#include "gl_state.h"
+#include "job_system.h"
+#include "lod.h"
+#include "mesh.h"
+#include "shader.h"
+#include "texture.h"
+#include "trace.h"
+
+
+namespace fs = std::experimental::filesystem;
+
+const fs::path shader_dir = fs::path(SHADER_DIR)/"lod";
+const fs::path texture_dir(TEXTURE_DIR);
+
+const int GRID_SIZE = 32;          // spheres along each side of the grid
+const float GRID_SPACING = 1.5f;   // distance between neighbouring spheres
+const float SPHERE_RADIUS = 0.5f;
+const float ERROR_PIXELS = 1.0f;   // largest projected error a level may show
+const float HYSTERESIS = 0.25f;    // margin before switching to a coarser level
+
+bool lod_enabled = true;
+bool reverse_z = false;
+int viewport_height = 600;
+Camera camera;
+
+void resizeWindowCallback(GLFWwindow* window, int width, int height) {
+  glViewport(0, 0, width, height);
+  camera.setViewport(width, height);
+  viewport_height = height;
+}
+
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+    lod_enabled = !lod_enabled;
+    std::cout << "levels of detail " << (lod_enabled ? "on" : "off") << std::endl;
+  }
+  if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+    if (!GLEW_ARB_clip_control) {
+      std::cout << "reverse Z needs ARB_clip_control" << std::endl;
+      return;
+    }
+    reverse_z = !reverse_z;
+    std::cout << "reverse Z " << (reverse_z ? "on, infinite far plane" : "off") << std::endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  /**
+   * Create the window and its context, or an offscreen one with --headless
+   */
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv));
+  if (!context.valid())
+    return -1;
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
+  context.setKeyCallback(keyCallback);
+
+  /**
+   * Start the slow startup work: the level of detail chain and the image decoding
+   * on the workers, each texture upload on the main thread once its image is decoded
+   */
+  JobSystem jobs;
+  LodChain chain;
+  JobSystem::JobHandle chain_job = jobs.run([&chain]() { chain = buildLodChain(createSphere(32, 64)); });
+
+  stbi_set_flip_vertically_on_load(true);
+  Image image1, image2;
+  GLTexture texture1, texture2;
+  JobSystem::JobHandle decode1 = jobs.run([&image1]() { image1 = decodeImage(texture_dir/"container.jpg"); });
+  JobSystem::JobHandle decode2 = jobs.run([&image2]() { image2 = decodeImage(texture_dir/"awesomeface.png"); });
+  JobSystem::JobHandle upload1 = jobs.run([&]() { uploadImage(texture1, image1, GL_RGB); },
+                                          {decode1}, JobSystem::Affinity::MainThread);
+  JobSystem::JobHandle upload2 = jobs.run([&]() { uploadImage(texture2, image2, GL_RGBA); },
+                                          {decode2}, JobSystem::Affinity::MainThread);
+
+  /**
+   * Build and compile shader program
+   */
+  const fs::path vert_shader_path = shader_dir/"lod.vert";
+  const fs::path frag_shader_path = shader_dir/"lod.frag";
+  ShaderProgram shaderProgram(vert_shader_path.c_str(), frag_shader_path.c_str());
+
+  /**
+   * Put all the levels of detail of the sphere in one vertex and index buffer
+   */
+  jobs.wait(chain_job);
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  std::vector<GLint> base_vertex;
+  std::vector<size_t> first_index;
+  for (size_t level = 0; level < chain.size(); level++) {
+    const Mesh& mesh = chain.levels[level];
+    std::cout << "level " << level << ": " << mesh.triangleCount() << " triangles, error "
+              << chain.errors[level] << std::endl;
+    base_vertex.push_back((GLint)vertices.size());
+    first_index.push_back(indices.size());
+    vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+  }
+
+  unsigned int VBO;           // vertex buffer object (vertices in GPU)
+  unsigned int EBO;           // element buffer object
+  unsigned int instanceVBO;   // per instance model matrices, grouped by level
+  unsigned int VAO;           // vertex array object
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  glGenBuffers(1, &instanceVBO);
+  glGenVertexArrays(1, &VAO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+
+  // position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // texture coord attribute
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  // model matrix attribute, one column per location, advanced once per instance
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  for (int column = 0; column < 4; column++) {
+    glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void*)(column * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(2 + column);
+    glVertexAttribDivisor(2 + column, 1);
+  }
+
+  /**
+   * Set up texture data
+   */
+  jobs.wait(upload1);
+  jobs.wait(upload2);
+
+  shaderProgram.use();
+  shaderProgram.setInt("texture1", 1);
+  shaderProgram.setInt("texture2", 0);
+
+  /**
+   * Set up the scene: a grid of spheres on the ground, each remembering its level
+   */
+  const int object_count = GRID_SIZE * GRID_SIZE;
+  std::vector<glm::vec3> positions(object_count);
+  for (int i = 0; i < object_count; i++)
+    positions[i] = GRID_SPACING * glm::vec3(i % GRID_SIZE - GRID_SIZE / 2, 0.0f, -(i / GRID_SIZE));
+  std::vector<int> levels(object_count, 0);
+  std::vector<int> level_counts(chain.size()), level_offsets(chain.size());
+  std::vector<glm::mat4> instances(object_count);
+
+  // the render loop binds through the cache, which drops what is still bound from the last frame
+  GLState state_cache;
+  state_cache.enable(GL_DEPTH_TEST);
+  state_cache.enable(GL_CULL_FACE);
+
+  double last_report = context.time();
+  int frames = 0;
+  size_t triangles = 0;
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    const float time = (float)context.time();
+    TRACE_ZONE_BEGIN(update, "update");
+
+    // reverse Z stores depth as near / distance in [0, 1], which needs the matching clip convention
+    if (reverse_z != camera.reverseZ()) {
+      camera.setReverseZ(reverse_z);
+      camera.setPerspective(glm::radians(45.0f), 0.1f, reverse_z ? INFINITY : 100.0f);
+      glClipControl(GL_LOWER_LEFT, reverse_z ? GL_ZERO_TO_ONE : GL_NEGATIVE_ONE_TO_ONE);
+      state_cache.depthFunc(reverse_z ? GL_GREATER : GL_LESS);
+      glClearDepth(reverse_z ? 0.0 : 1.0);
+    }
+
+    // dolly back and forth over the field
+    const glm::vec3 eye(0.0f, 2.0f, 4.0f - 20.0f * (1.0f - std::cos(0.2f * time)));
+    camera.lookAt(eye, eye + glm::vec3(0.0f, -0.1f, -1.0f));
+
+    // pick every sphere's level from the distance to its surface
+    std::fill(level_counts.begin(), level_counts.end(), 0);
+    for (int i = 0; i < object_count; i++) {
+      if (lod_enabled) {
+        const float distance = glm::length(positions[i] - eye) - SPHERE_RADIUS;
+        const float pixels_per_unit = pixelsPerUnit(camera.projection(), (float)viewport_height, distance);
+        levels[i] = selectLod(chain, levels[i], pixels_per_unit, ERROR_PIXELS, HYSTERESIS);
+      }
+      else {
+        levels[i] = 0;
+      }
+      level_counts[levels[i]]++;
+    }
+    // group the instances by level
+    for (size_t level = 0, offset = 0; level < chain.size(); offset += level_counts[level++])
+      level_offsets[level] = (int)offset;
+    for (int i = 0; i < object_count; i++) {
+      const glm::mat4 model = glm::rotate(glm::translate(glm::mat4(1.0f), positions[i]),
+                                          0.5f * time + i, glm::vec3(0.0f, 1.0f, 0.0f));
+      instances[level_offsets[levels[i]]++] = model;
+    }
+
+    TRACE_ZONE_END(update);
+    TRACE_ZONE_BEGIN(submit, "submit");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    state_cache.bindTexture(0, GL_TEXTURE_2D, texture1);
+    state_cache.bindTexture(1, GL_TEXTURE_2D, texture2);
+
+    state_cache.useProgram(shaderProgram.ID);
+    unsigned int viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(camera.view()));
+    unsigned int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(camera.projection()));
+
+    // render, one instanced draw per level
+    state_cache.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, object_count * sizeof(glm::mat4), instances.data(), GL_STREAM_DRAW);
+    state_cache.bindVertexArray(VAO);
+    for (size_t level = 0, base_instance = 0; level < chain.size(); base_instance += level_counts[level++]) {
+      if (level_counts[level] == 0)
+        continue;
+      const Mesh& mesh = chain.levels[level];
+      glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT,
+                                                    (void*)(first_index[level] * sizeof(uint32_t)),
+                                                    level_counts[level], base_vertex[level], (GLuint)base_instance);
+      triangles += mesh.triangleCount() * level_counts[level];
+    }
+    TRACE_ZONE_END(submit);
+
+    context.swapBuffers();
+    context.pollEvents();
+
+    frames++;
+    if (context.time() - last_report >= 1.0) {
+      std::cout << frames << " fps, " << triangles / frames << " triangles per frame, spheres per level:";
+      for (int count : level_counts)
+        std::cout << " " << count;
+      const GLState::Stats state_stats = state_cache.takeStats();
+      std::cout << ", " << state_stats.filtered / frames << " of " << state_stats.calls / frames
+                << " state calls filtered" << std::endl;
+      last_report = context.time();
+      frames = 0;
+      triangles = 0;
+    }
+  }
+
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  glDeleteBuffers(1, &instanceVBO);
+
+  return 0;
+}
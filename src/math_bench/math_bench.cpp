@@ -0,0 +1,191 @@
+// Times the glm functions the samples lean on, for the configuration this copy was
+// built with: MathBenchScalar uses glm's plain C++ code, MathBenchSimd its SSE/AVX
+// intrinsics and aligned types. Run both on the target CPU to pick a build setting.
+// The sine and cosine kernels of fast_math.h are measured against glm's too.
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <thirdparty/glm/gtx/fast_trigonometry.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "fast_math.h"
+
+
+const size_t ELEMENT_COUNT = 1024;   // matrices per call, small enough to stay in cache
+const size_t ITERATIONS = 200;
+
+std::string configuration() {
+  std::string name;
+#if GLM_CONFIG_SIMD == GLM_ENABLE
+  name = "glm intrinsics";
+  if (GLM_ARCH & GLM_ARCH_AVX2_BIT)
+    name += " (AVX2)";
+  else if (GLM_ARCH & GLM_ARCH_AVX_BIT)
+    name += " (AVX)";
+  else if (GLM_ARCH & GLM_ARCH_SSE41_BIT)
+    name += " (SSE4.1)";
+  else if (GLM_ARCH & GLM_ARCH_SSE2_BIT)
+    name += " (SSE2)";
+  else if (GLM_ARCH & GLM_ARCH_NEON_BIT)
+    name += " (NEON)";
+#else
+  name = "glm pure C++";
+#endif
+#if GLM_CONFIG_ALIGNED_GENTYPES == GLM_ENABLE
+  name += ", aligned types available";
+#endif
+  return name;
+}
+
+// every function over ELEMENT_COUNT inputs, reported per element; Q picks the glm types
+template <glm::qualifier Q>
+void runSuite(const std::string& types, std::vector<double>& baseline) {
+  typedef glm::mat<4, 4, float, Q> Mat4;
+  typedef glm::vec<4, float, Q> Vec4;
+  typedef glm::vec<3, float, Q> Vec3;
+
+  std::vector<Mat4> a(ELEMENT_COUNT), b(ELEMENT_COUNT), c(ELEMENT_COUNT);
+  std::vector<Vec4> v(ELEMENT_COUNT), w(ELEMENT_COUNT);
+  std::vector<Vec3> eyes(ELEMENT_COUNT);
+  std::vector<float> angles(ELEMENT_COUNT);
+  for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+    const float t = 0.001f * i;
+    angles[i] = t;
+    eyes[i] = Vec3(std::sin(t), 2.0f, 5.0f + std::cos(t));
+    a[i] = glm::rotate(glm::translate(Mat4(1.0f), Vec3(t, 1.0f, -t)), t, Vec3(0.0f, 1.0f, 0.0f));
+    b[i] = glm::scale(Mat4(1.0f), Vec3(1.0f + t));
+    v[i] = Vec4(t, 1.0f, 2.0f, 1.0f);
+  }
+  const Vec3 axis = glm::normalize(Vec3(1.0f, 2.0f, 3.0f));
+  const Vec3 center(0.0f), up(0.0f, 1.0f, 0.0f);
+
+  std::vector<std::pair<std::string, double>> results;
+  results.emplace_back("mat4 * mat4", measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      c[i] = a[i] * b[i];
+    doNotOptimize(c.data());
+  }, ITERATIONS));
+  results.emplace_back("inverse", measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      c[i] = glm::inverse(a[i]);
+    doNotOptimize(c.data());
+  }, ITERATIONS));
+  results.emplace_back("rotate", measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      c[i] = glm::rotate(a[i], angles[i], axis);
+    doNotOptimize(c.data());
+  }, ITERATIONS));
+  results.emplace_back("perspective", measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      c[i] = Mat4(glm::perspective(0.5f + angles[i], 800.0f / 600.0f, 0.1f, 100.0f));
+    doNotOptimize(c.data());
+  }, ITERATIONS));
+  results.emplace_back("lookAt", measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      c[i] = glm::lookAt(eyes[i], center, up);
+    doNotOptimize(c.data());
+  }, ITERATIONS));
+  results.emplace_back("mat4 * vec4", measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      w[i] = a[i] * v[i];
+    doNotOptimize(w.data());
+  }, ITERATIONS));
+
+  std::cout << types << ":" << std::endl;
+  for (size_t i = 0; i < results.size(); i++) {
+    const double ns = results[i].second / ELEMENT_COUNT;
+    report(results[i].first, ns, i < baseline.size() ? baseline[i] : 0.0);
+    if (baseline.size() < results.size())
+      baseline.push_back(ns);
+  }
+}
+
+// name with the largest difference from double precision sin and cos
+std::string withError(const std::string& name, const std::vector<float>& angles,
+                      const std::vector<float>& sines, const std::vector<float>& cosines) {
+  double error = 0.0;
+  for (size_t i = 0; i < angles.size(); i++) {
+    error = std::max(error, std::abs(sines[i] - std::sin((double)angles[i])));
+    error = std::max(error, std::abs(cosines[i] - std::cos((double)angles[i])));
+  }
+  char text[32];
+  std::snprintf(text, sizeof(text), " (error %.1e)", error);
+  return name + text;
+}
+
+// sine and cosine of ELEMENT_COUNT angles over a few turns, and the rotations built from them
+void runTrigSuite() {
+  std::vector<float> angles(ELEMENT_COUNT), sines(ELEMENT_COUNT), cosines(ELEMENT_COUNT);
+  for (size_t i = 0; i < ELEMENT_COUNT; i++)
+    angles[i] = -20.0f + 40.0f * i / ELEMENT_COUNT;
+
+  std::cout << "sine and cosine:" << std::endl;
+  const double std_ns = measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+      sines[i] = std::sin(angles[i]);
+      cosines[i] = std::cos(angles[i]);
+    }
+    doNotOptimize(sines.data());
+  }, ITERATIONS) / ELEMENT_COUNT;
+  report(withError("std::sin, std::cos", angles, sines, cosines), std_ns);
+  const double glm_ns = measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+      sines[i] = glm::fastSin(angles[i]);
+      cosines[i] = glm::fastCos(angles[i]);
+    }
+    doNotOptimize(sines.data());
+  }, ITERATIONS) / ELEMENT_COUNT;
+  report(withError("glm::fastSin, glm::fastCos", angles, sines, cosines), glm_ns, std_ns);
+  const std::pair<TrigPrecision, const char*> precisions[] = {
+    {TrigPrecision::Fast, "fastSinCos, Fast"},
+    {TrigPrecision::Accurate, "fastSinCos, Accurate"},
+  };
+  for (const auto& precision : precisions) {
+    const double ns = measure([&] {
+      fastSinCos(angles.data(), sines.data(), cosines.data(), ELEMENT_COUNT, precision.first);
+      doNotOptimize(sines.data());
+    }, ITERATIONS) / ELEMENT_COUNT;
+    report(withError(precision.second, angles, sines, cosines), ns, std_ns);
+  }
+
+  std::vector<glm::mat4> models(ELEMENT_COUNT);
+  const glm::mat4 base = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f));
+  std::cout << "rotation about the x axis:" << std::endl;
+  const double rotate_ns = measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      models[i] = glm::rotate(base, angles[i], glm::vec3(1.0f, 0.0f, 0.0f));
+    doNotOptimize(models.data());
+  }, ITERATIONS) / ELEMENT_COUNT;
+  report("glm::rotate", rotate_ns);
+  report("rotateX", measure([&] {
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      models[i] = rotateX(base, angles[i]);
+    doNotOptimize(models.data());
+  }, ITERATIONS) / ELEMENT_COUNT, rotate_ns);
+  report("fastSinCos, Fast + rotateX", measure([&] {
+    fastSinCos(angles.data(), sines.data(), cosines.data(), ELEMENT_COUNT, TrigPrecision::Fast);
+    for (size_t i = 0; i < ELEMENT_COUNT; i++)
+      models[i] = rotateX(base, sines[i], cosines[i]);
+    doNotOptimize(models.data());
+  }, ITERATIONS) / ELEMENT_COUNT, rotate_ns);
+}
+
+
+int main() {
+  std::cout << configuration() << ", nanoseconds per element:" << std::endl;
+  std::vector<double> baseline;
+  runSuite<glm::packed_highp>("glm::mat4, glm::vec4", baseline);
+#if GLM_CONFIG_ALIGNED_GENTYPES == GLM_ENABLE
+  runSuite<glm::aligned_highp>("glm::aligned_mat4, glm::aligned_vec4", baseline);
+#endif
+  runTrigSuite();
+  return 0;
+}
@@ -0,0 +1,184 @@
+// A finely tessellated planet split into meshlets, the ones outside the frustum or
+// facing away culled on the CPU before every draw (M toggles)
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+#include <thirdparty/glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include<experimental/filesystem>
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <thirdparty/stb_image.h>
+
+#include "Config.h"
+#include "context.h"
+#include "context_tools.h"
+#include "mesh.h"
+#include "meshlet.h"
+#include "shader.h"
+#include "texture.h"
+#include "trace.h"
+
+
+namespace fs = std::experimental::filesystem;
+
+const fs::path shader_dir = fs::path(SHADER_DIR)/"meshlets";
+const fs::path texture_dir(TEXTURE_DIR);
+
+const float PLANET_SCALE = 20.0f;
+
+bool meshlet_culling = true;
+
+void resizeWindowCallback(GLFWwindow* window, int width, int height) {
+  const int w = std::min(width, 4*height/3);
+  const int h = std::min(height, 3*width/4);
+  glViewport(0, 0, w, h);
+}
+
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+    meshlet_culling = !meshlet_culling;
+    std::cout << "meshlet culling " << (meshlet_culling ? "on" : "off") << std::endl;
+  }
+}
+
+
+int main(int argc, char** argv) {
+  /**
+   * Create the window and its context, or an offscreen one with --headless
+   */
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv));
+  if (!context.valid())
+    return -1;
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
+  context.setKeyCallback(keyCallback);
+
+  /**
+   * Build and compile shader program
+   */
+  const fs::path vert_shader_path = shader_dir/"meshlets.vert";
+  const fs::path frag_shader_path = shader_dir/"meshlets.frag";
+  ShaderProgram shaderProgram(vert_shader_path.c_str(), frag_shader_path.c_str());
+
+  /**
+   * Set up vertex data and buffers and configure vertex attribues
+   */
+  const Mesh planet = createSphere(256, 512);
+  const MeshletBuffer meshlets = buildMeshlets(planet);
+  std::cout << planet.triangleCount() << " triangles in " << meshlets.meshlets.size() << " meshlets" << std::endl;
+
+  unsigned int VBO;   // vertex buffer object (vertices in GPU)
+  unsigned int VAO;   // vertex array object (stores vertex attribute calls)
+  unsigned int EBO;   // element buffer object, refilled with the visible meshlets every frame
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, planet.vertices.size() * sizeof(Vertex), planet.vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+  // position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // texture coord attribute
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  /**
+   * Set up texture data
+   */
+  stbi_set_flip_vertically_on_load(true);
+  GLTexture texture1 = loadTexture(texture_dir/"container.jpg", GL_RGB);
+  GLTexture texture2 = loadTexture(texture_dir/"awesomeface.png", GL_RGBA);
+
+  shaderProgram.use();
+  shaderProgram.setInt("texture1", 1);
+  shaderProgram.setInt("texture2", 0);
+
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+
+  std::vector<uint32_t> indices;
+  double last_report = context.time();
+  int frames = 0;
+  size_t visible_meshlets = 0;
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    const float time = (float)context.time();
+    TRACE_ZONE_BEGIN(update, "update");
+
+    // skim over the surface of the spinning planet
+    const glm::mat4 model = glm::rotate(glm::scale(glm::mat4(1.0f), glm::vec3(PLANET_SCALE)),
+                                        0.05f * time, glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::vec3 eye(0.0f, 0.0f, 0.5f * PLANET_SCALE + 1.5f);
+    const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 0.5f * PLANET_SCALE, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+
+    // cull in the planet's object space and draw what is left from a compacted index stream
+    indices.clear();
+    if (meshlet_culling) {
+      const Frustum frustum = Frustum::fromMatrix(projection * view * model);
+      const glm::vec3 camera = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+      visible_meshlets = cullMeshlets(meshlets, frustum, camera, indices);
+    }
+    else {
+      indices = planet.indices;
+      visible_meshlets = meshlets.meshlets.size();
+    }
+
+    TRACE_ZONE_END(update);
+    TRACE_ZONE_BEGIN(submit, "submit");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, texture2);
+
+    shaderProgram.use();
+    unsigned int modelLoc = glGetUniformLocation(shaderProgram.ID, "model");
+    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    unsigned int viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    unsigned int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+    // render
+    glBindVertexArray(VAO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STREAM_DRAW);
+    glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+    TRACE_ZONE_END(submit);
+
+    context.swapBuffers();
+    context.pollEvents();
+
+    frames++;
+    if (context.time() - last_report >= 1.0) {
+      std::cout << frames << " fps, " << visible_meshlets << "/" << meshlets.meshlets.size() << " meshlets, "
+                << indices.size() / 3 << " triangles drawn" << std::endl;
+      last_report = context.time();
+      frames = 0;
+    }
+  }
+
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+
+  return 0;
+}
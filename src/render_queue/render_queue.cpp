@@ -0,0 +1,339 @@
+// A field of cubes and spheres with two programs, two texture sets and a handful of
+// tinted materials, some of them translucent, submitted through a render queue that
+// sorts the draws by state and depth (Q toggles back to the order they were created in).
+// Worker threads build the keys and record the draws into command buffers, which the
+// main thread replays through the GL state cache; the cache drops the calls that would
+// not change anything (C toggles recording on the main thread alone, V toggles checking
+// the cache against the driver).
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+#include <thirdparty/glm/gtc/type_ptr.hpp>
+
+#include <chrono>
+#include <cmath>
+#include<experimental/filesystem>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <thirdparty/stb_image.h>
+
+#include "Config.h"
+#include "command_buffer.h"
+#include "context.h"
+#include "context_tools.h"
+#include "gl_state.h"
+#include "job_system.h"
+#include "mesh.h"
+#include "render_queue.h"
+#include "shader.h"
+#include "texture.h"
+#include "trace.h"
+
+
+namespace fs = std::experimental::filesystem;
+
+const fs::path shader_dir = fs::path(SHADER_DIR)/"render_queue";
+const fs::path texture_dir(TEXTURE_DIR);
+
+const int GRID_SIZE = 48;           // objects along each side of the grid
+const float GRID_SPACING = 1.5f;    // distance between neighbouring objects
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 200.0f;
+const int MATERIAL_COUNT = 8;
+const int TRANSLUCENT_MATERIALS = 2;   // the last materials are see through
+const size_t BUFFERS_PER_THREAD = 4;   // command buffers recorded per thread and frame, for balance
+
+bool sorted = true;
+bool parallel_recording = true;
+bool validate_state = false;
+
+void resizeWindowCallback(GLFWwindow* window, int width, int height) {
+  const int w = std::min(width, 4*height/3);
+  const int h = std::min(height, 3*width/4);
+  glViewport(0, 0, w, h);
+}
+
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  if (key == GLFW_KEY_Q && action == GLFW_PRESS) {
+    sorted = !sorted;
+    std::cout << (sorted ? "sorted by state and depth" : "in creation order") << std::endl;
+  }
+  if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+    parallel_recording = !parallel_recording;
+    std::cout << "recording " << (parallel_recording ? "on all threads" : "on the main thread") << std::endl;
+  }
+  if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+    validate_state = !validate_state;
+    std::cout << "state cache validation " << (validate_state ? "on" : "off") << std::endl;
+  }
+}
+
+// program with the uniform locations the draws set
+struct Program {
+  ShaderProgram shader;
+  unsigned int id;
+  GLint model, view, projection, tint;
+};
+
+Program createProgram(const fs::path& vert_shader_path, const fs::path& frag_shader_path) {
+  Program program{ShaderProgram(vert_shader_path.c_str(), frag_shader_path.c_str())};
+  ShaderProgram& shader = program.shader;
+  program.id = shader.ID;
+  program.model = glGetUniformLocation(shader.ID, "model");
+  program.view = glGetUniformLocation(shader.ID, "view");
+  program.projection = glGetUniformLocation(shader.ID, "projection");
+  program.tint = glGetUniformLocation(shader.ID, "tint");
+  shader.use();
+  shader.setInt("texture1", 0);
+  shader.setInt("texture2", 1);
+  return program;
+}
+
+// vertex array of a mesh
+struct Geometry {
+  unsigned int VAO, VBO, EBO;
+  GLsizei index_count;
+};
+
+Geometry createGeometry(const Mesh& mesh) {
+  Geometry geometry;
+  glGenVertexArrays(1, &geometry.VAO);
+  glGenBuffers(1, &geometry.VBO);
+  glGenBuffers(1, &geometry.EBO);
+  glBindVertexArray(geometry.VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, geometry.VBO);
+  glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(Vertex), mesh.vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(), GL_STATIC_DRAW);
+
+  // position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // texture coord attribute
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  geometry.index_count = (GLsizei)mesh.indices.size();
+  return geometry;
+}
+
+struct Object {
+  glm::mat4 model;
+  RenderQueue::State state;
+};
+
+
+int main(int argc, char** argv) {
+  /**
+   * Create the window and its context, or an offscreen one with --headless
+   */
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv));
+  if (!context.valid())
+    return -1;
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
+  context.setKeyCallback(keyCallback);
+
+  /**
+   * Build and compile the programs, the state ids of the keys index these tables
+   */
+  const fs::path vert_shader_path = shader_dir/"render_queue.vert";
+  const Program programs[] = {
+    createProgram(vert_shader_path, shader_dir/"mixed.frag"),
+    createProgram(vert_shader_path, shader_dir/"single.frag"),
+  };
+
+  const Geometry geometries[] = {createGeometry(createCube()), createGeometry(createSphere(16, 32))};
+
+  stbi_set_flip_vertically_on_load(true);
+  GLTexture container = loadTexture(texture_dir/"container.jpg", GL_RGB);
+  GLTexture face = loadTexture(texture_dir/"awesomeface.png", GL_RGBA);
+  const unsigned int texture_sets[][2] = {{container, face}, {face, container}};
+
+  glm::vec4 materials[MATERIAL_COUNT];
+  for (int i = 0; i < MATERIAL_COUNT; i++) {
+    const float hue = (float)i / MATERIAL_COUNT;
+    const glm::vec3 color = glm::clamp(glm::abs(glm::mod(6.0f * hue + glm::vec3(0.0f, 4.0f, 2.0f), 6.0f) - 3.0f) - 1.0f,
+                                       0.0f, 1.0f);
+    materials[i] = glm::vec4(0.5f + 0.5f * color, i < MATERIAL_COUNT - TRANSLUCENT_MATERIALS ? 1.0f : 0.5f);
+  }
+
+  /**
+   * Set up the scene: every object with its own mix of states, in no particular order
+   */
+  std::mt19937 random(1);
+  std::vector<Object> objects;
+  for (int i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+    Object object;
+    const glm::vec3 position = GRID_SPACING * glm::vec3(i % GRID_SIZE - GRID_SIZE / 2, 0.0f, i / GRID_SIZE - GRID_SIZE / 2);
+    object.model = glm::rotate(glm::translate(glm::mat4(1.0f), position), (float)(random() % 360), glm::vec3(0.0f, 1.0f, 0.0f));
+    object.state.program = (uint8_t)(random() % 2);
+    object.state.textures = (uint8_t)(random() % 2);
+    object.state.material = (uint8_t)(random() % MATERIAL_COUNT);
+    object.state.vao = (uint8_t)(random() % 2);
+    objects.push_back(object);
+  }
+
+  // from here on all state goes through the cache
+  GLState state_cache;
+  state_cache.enable(GL_DEPTH_TEST);
+  state_cache.enable(GL_CULL_FACE);
+  state_cache.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  // record the draws of items [begin, end), setting all of their state
+  auto recordDraws = [&](CommandBuffer& commands, const RenderQueue::Item* begin, const RenderQueue::Item* end) {
+    commands.clear();
+    RenderQueue::State bound;
+    for (const RenderQueue::Item* item = begin; item != end; item++) {
+      const RenderQueue::State state = RenderQueue::state(item->key);
+      const bool translucent = RenderQueue::translucent(item->key);
+      if (translucent)
+        commands.enable(GL_BLEND);
+      else
+        commands.disable(GL_BLEND);
+      commands.depthMask(!translucent);
+      const Program& program = programs[state.program];
+      commands.useProgram(program.id);
+      commands.bindTexture(0, GL_TEXTURE_2D, texture_sets[state.textures][0]);
+      commands.bindTexture(1, GL_TEXTURE_2D, texture_sets[state.textures][1]);
+      commands.bindVertexArray(geometries[state.vao].VAO);
+      // uniforms are not cached, the material is only set again when it or the program changes
+      if (item == begin || state.program != bound.program || state.material != bound.material)
+        commands.uniform4(program.tint, glm::value_ptr(materials[state.material]));
+      bound = state;
+
+      commands.uniformMatrix4(program.model, glm::value_ptr(objects[item->index].model));
+      commands.drawElements(GL_TRIANGLES, geometries[state.vao].index_count, GL_UNSIGNED_INT, 0);
+    }
+  };
+
+  JobSystem jobs;
+  std::vector<CommandBuffer> command_buffers(jobs.threadCount() * BUFFERS_PER_THREAD);
+  std::cout << objects.size() << " objects recorded on " << jobs.threadCount() << " threads" << std::endl;
+
+  RenderQueue queue;
+  double last_report = context.time();
+  int frames = 0;
+  RenderQueue::StateChanges unsorted_total, submitted_total;
+  size_t state_calls = 0, filtered_calls = 0;
+  double record_ms = 0.0, replay_ms = 0.0;
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    const float time = (float)context.time();
+    TRACE_ZONE_BEGIN(sort, "sort");
+
+    const glm::vec3 eye(40.0f * std::sin(0.1f * time), 15.0f, 40.0f * std::cos(0.1f * time));
+    const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, NEAR_PLANE, FAR_PLANE);
+
+    // a key per object, depth along the view direction
+    const auto record_start = std::chrono::steady_clock::now();
+    const size_t threads = parallel_recording ? jobs.threadCount() : 1;
+    queue.resize(objects.size());
+    auto buildKeys = [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const Object& object = objects[i];
+        const float distance = -(view * object.model[3]).z;
+        const uint32_t depth = RenderQueue::quantizeDepth(distance, NEAR_PLANE, FAR_PLANE);
+        const bool translucent = materials[object.state.material].a < 1.0f;
+        queue[i] = RenderQueue::Item{translucent ? RenderQueue::translucentKey(object.state, depth)
+                                                 : RenderQueue::opaqueKey(object.state, depth), (uint32_t)i};
+      }
+    };
+    if (threads > 1)
+      jobs.parallelFor(objects.size(), buildKeys);
+    else
+      buildKeys(0, objects.size());
+    const RenderQueue::StateChanges unsorted = queue.stateChanges();
+    if (sorted)
+      queue.sort();
+    const RenderQueue::StateChanges submitted = queue.stateChanges();
+
+    TRACE_ZONE_END(sort);
+    TRACE_ZONE_BEGIN(record, "record");
+    // record the sorted draws in consecutive ranges, one command buffer each
+    const size_t buffer_count = threads * BUFFERS_PER_THREAD;
+    auto recordRange = [&](size_t begin, size_t end) {
+      for (size_t buffer = begin; buffer < end; buffer++) {
+        recordDraws(command_buffers[buffer], queue.begin() + buffer * queue.size() / buffer_count,
+                    queue.begin() + (buffer + 1) * queue.size() / buffer_count);
+      }
+    };
+    if (threads > 1)
+      jobs.parallelFor(buffer_count, recordRange, 1);
+    else
+      recordRange(0, buffer_count);
+    const auto record_end = std::chrono::steady_clock::now();
+    record_ms += std::chrono::duration<double, std::milli>(record_end - record_start).count();
+    TRACE_ZONE_END(record);
+
+    TRACE_ZONE_BEGIN(submit, "submit");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    for (const Program& program : programs) {
+      glProgramUniformMatrix4fv(program.id, program.view, 1, GL_FALSE, glm::value_ptr(view));
+      glProgramUniformMatrix4fv(program.id, program.projection, 1, GL_FALSE, glm::value_ptr(projection));
+    }
+
+    // render, replaying the buffers in order, the cache passing on only the state changes
+    state_cache.setValidation(validate_state);
+    for (size_t buffer = 0; buffer < buffer_count; buffer++)
+      command_buffers[buffer].execute(state_cache);
+    // glClear obeys the depth mask
+    state_cache.depthMask(true);
+    replay_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - record_end).count();
+    TRACE_ZONE_END(submit);
+
+    context.swapBuffers();
+    context.pollEvents();
+
+    const GLState::Stats state_stats = state_cache.takeStats();
+    filtered_calls += state_stats.filtered;
+    state_calls += state_stats.calls;
+    frames++;
+    unsorted_total.programs += unsorted.programs;
+    unsorted_total.textures += unsorted.textures;
+    submitted_total.programs += submitted.programs;
+    submitted_total.textures += submitted.textures;
+    submitted_total.materials += submitted.materials;
+    submitted_total.vaos += submitted.vaos;
+    if (context.time() - last_report >= 1.0) {
+      // a texture set change binds both texture units
+      std::cout << frames << " fps, per frame " << submitted_total.programs / frames << " glUseProgram, "
+                << 2 * submitted_total.textures / frames << " glBindTexture, "
+                << submitted_total.materials / frames << " material and "
+                << submitted_total.vaos / frames << " vertex array changes; "
+                << (unsorted_total.programs - submitted_total.programs) / frames << " glUseProgram and "
+                << 2 * (unsorted_total.textures - submitted_total.textures) / frames
+                << " glBindTexture calls saved by sorting; "
+                << filtered_calls / frames << " of " << state_calls / frames
+                << " state calls filtered by the cache; " << record_ms / frames << " ms recording, "
+                << replay_ms / frames << " ms replaying" << std::endl;
+      last_report = context.time();
+      frames = 0;
+      unsorted_total = submitted_total = RenderQueue::StateChanges();
+      state_calls = filtered_calls = 0;
+      record_ms = replay_ms = 0.0;
+    }
+  }
+
+  for (const Geometry& geometry : geometries) {
+    glDeleteVertexArrays(1, &geometry.VAO);
+    glDeleteBuffers(1, &geometry.VBO);
+    glDeleteBuffers(1, &geometry.EBO);
+  }
+
+  return 0;
+}
@@ -0,0 +1,306 @@
+// A field of jointed arms in a scene graph, only the animated ones recomputed every
+// frame, spread over the job system's threads, while the static ones cost nothing
+// (space pauses the animation). A simulation thread updates the next frame while
+// the main thread draws the current one (P toggles back to one thread doing both).
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+#include <thirdparty/glm/gtc/type_ptr.hpp>
+
+#include <atomic>
+#include <cmath>
+#include<experimental/filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <thirdparty/stb_image.h>
+
+#include "Config.h"
+#include "context.h"
+#include "context_tools.h"
+#include "frame_pipeline.h"
+#include "gl_state.h"
+#include "job_system.h"
+#include "mesh.h"
+#include "scene_graph.h"
+#include "shader.h"
+#include "texture.h"
+#include "trace.h"
+
+
+namespace fs = std::experimental::filesystem;
+
+const fs::path shader_dir = fs::path(SHADER_DIR)/"scene_graph";
+const fs::path texture_dir(TEXTURE_DIR);
+
+const int GRID_SIZE = 32;          // arms along each side of the grid
+const float GRID_SPACING = 3.0f;   // distance between neighbouring arms
+const int SEGMENT_COUNT = 8;       // joints in every arm, each one a child of the one below
+const float SEGMENT_LENGTH = 1.0f;
+const float CUBE_SCALE = 0.4f;
+const size_t NODES_PER_TASK = 256;
+const size_t FRAME_PACKETS = 2;    // double buffered, the simulation runs at most one frame ahead
+
+// everything the render thread needs from the simulation for one frame
+struct FramePacket {
+  glm::mat4 view;
+  glm::mat4 projection;
+  std::vector<glm::mat4> world;    // world matrices in the scene graph's order, one instance each
+  size_t updated = 0;              // nodes recomputed for this frame, world is only filled if any
+};
+
+std::atomic<bool> paused(false);   // read by the simulation thread
+bool pipelined = true;
+
+void resizeWindowCallback(GLFWwindow* window, int width, int height) {
+  const int w = std::min(width, 4*height/3);
+  const int h = std::min(height, 3*width/4);
+  glViewport(0, 0, w, h);
+}
+
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+    paused = !paused;
+    std::cout << (paused ? "paused" : "animating") << std::endl;
+  }
+  if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+    pipelined = !pipelined;
+    std::cout << (pipelined ? "simulating on its own thread" : "simulating on the render thread") << std::endl;
+  }
+}
+
+
+// local matrix of joint k of an arm, swaying with time; joint 0 stands on the ground
+glm::mat4 jointMatrix(const glm::vec3& position, int joint, float phase, float time) {
+  if (joint == 0)
+    return glm::rotate(glm::translate(glm::mat4(1.0f), position), 0.3f * time + phase, glm::vec3(0.0f, 1.0f, 0.0f));
+  const float bend = 0.25f * std::sin(1.5f * time + phase + 0.5f * joint);
+  return glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, SEGMENT_LENGTH, 0.0f)), bend, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+
+int main(int argc, char** argv) {
+  /**
+   * Create the window and its context, or an offscreen one with --headless
+   */
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv));
+  if (!context.valid())
+    return -1;
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
+  context.setKeyCallback(keyCallback);
+
+  /**
+   * Build and compile shader program
+   */
+  const fs::path vert_shader_path = shader_dir/"scene_graph.vert";
+  const fs::path frag_shader_path = shader_dir/"scene_graph.frag";
+  ShaderProgram shaderProgram(vert_shader_path.c_str(), frag_shader_path.c_str());
+
+  /**
+   * Set up the scene: a grid of jointed arms, every other one animated and the rest static
+   */
+  JobSystem jobs;
+  SceneGraph scene;
+  scene.setParallelFor([&jobs](size_t task_count, const std::function<void(size_t)>& task) {
+    jobs.parallelFor(task_count, [&task](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++)
+        task(i);
+    }, 1);
+  }, NODES_PER_TASK);
+  std::vector<glm::vec3> positions;
+  std::vector<std::vector<SceneGraph::NodeId>> animated_arms;
+  for (int i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+    const glm::vec3 position = GRID_SPACING * glm::vec3(i % GRID_SIZE - GRID_SIZE / 2, 0.0f, -(i / GRID_SIZE));
+    std::vector<SceneGraph::NodeId> joints;
+    SceneGraph::NodeId parent = SceneGraph::NO_PARENT;
+    for (int joint = 0; joint < SEGMENT_COUNT; joint++) {
+      parent = scene.addNode(jointMatrix(position, joint, (float)i, 0.0f), parent);
+      joints.push_back(parent);
+    }
+    if ((i % GRID_SIZE + i / GRID_SIZE) % 2 == 0) {
+      positions.push_back(position);
+      animated_arms.push_back(joints);
+    }
+  }
+  scene.update();
+  std::cout << scene.size() << " nodes in " << scene.levelCount() << " levels, "
+            << animated_arms.size() * SEGMENT_COUNT << " of them animated, updated on "
+            << jobs.threadCount() << " threads" << std::endl;
+
+  /**
+   * Set up vertex data and buffers and configure vertex attribues
+   */
+  const Mesh cube = createCube();
+
+  unsigned int VBO;           // vertex buffer object (vertices in GPU)
+  unsigned int EBO;           // element buffer object
+  unsigned int instanceVBO;   // world matrix of every node, in the scene graph's order
+  unsigned int VAO;           // vertex array object
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  glGenBuffers(1, &instanceVBO);
+  glGenVertexArrays(1, &VAO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, cube.vertices.size() * sizeof(Vertex), cube.vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, cube.indices.size() * sizeof(uint32_t), cube.indices.data(), GL_STATIC_DRAW);
+
+  // position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // texture coord attribute
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  // model matrix attribute, one column per location, advanced once per instance
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  glBufferData(GL_ARRAY_BUFFER, scene.size() * sizeof(glm::mat4), scene.worldMatrices(), GL_DYNAMIC_DRAW);
+  for (int column = 0; column < 4; column++) {
+    glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void*)(column * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(2 + column);
+    glVertexAttribDivisor(2 + column, 1);
+  }
+
+  /**
+   * Set up texture data
+   */
+  stbi_set_flip_vertically_on_load(true);
+  GLTexture texture1 = loadTexture(texture_dir/"container.jpg", GL_RGB);
+  GLTexture texture2 = loadTexture(texture_dir/"awesomeface.png", GL_RGBA);
+
+  shaderProgram.use();
+  shaderProgram.setInt("texture1", 1);
+  shaderProgram.setInt("texture2", 0);
+  shaderProgram.setFloat("cubeScale", CUBE_SCALE);
+
+  // the render loop binds through the cache, which drops what is still bound from the last frame
+  GLState state_cache;
+  state_cache.enable(GL_DEPTH_TEST);
+  state_cache.enable(GL_CULL_FACE);
+
+  /**
+   * Simulation: animate the arms, update the scene graph and snapshot it with the camera
+   */
+  auto simulate = [&](FramePacket& packet) {
+    TRACE_ZONE("update");
+    const float time = (float)context.time();
+
+    const glm::vec3 eye(0.0f, 20.0f, 25.0f);
+    packet.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, -40.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    packet.projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 200.0f);
+
+    // only the animated arms touch their joints, the update skips everything else
+    if (!paused) {
+      for (size_t arm = 0; arm < animated_arms.size(); arm++) {
+        for (int joint = 0; joint < SEGMENT_COUNT; joint++)
+          scene.setLocal(animated_arms[arm][joint], jointMatrix(positions[arm], joint, (float)arm, time));
+      }
+    }
+    packet.updated = scene.update();
+    if (packet.updated > 0)
+      packet.world.assign(scene.worldMatrices(), scene.worldMatrices() + scene.size());
+  };
+
+  FramePipeline<FramePacket, FRAME_PACKETS> pipeline;
+  std::thread simulation;
+  auto simulationLoop = [&]() {
+    TRACE_THREAD_NAME("simulation");
+    while (FramePacket* packet = pipeline.beginWrite()) {
+      simulate(*packet);
+      pipeline.publish();
+    }
+  };
+
+  double last_report = context.time();
+  size_t updated_nodes = 0;
+  // the instance buffer gets the world matrices of every packet that has them
+  auto upload = [&](const FramePacket& packet) {
+    TRACE_ZONE("upload");
+    state_cache.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (packet.updated > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, 0, packet.world.size() * sizeof(glm::mat4), packet.world.data());
+    updated_nodes += packet.updated;
+  };
+
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+
+    // start or retire the simulation thread, the scene graph only ever has one writer
+    if (pipelined && !simulation.joinable()) {
+      simulation = std::thread(simulationLoop);
+    }
+    else if (!pipelined && simulation.joinable()) {
+      pipeline.stop();
+      simulation.join();
+      // the packets it published last may hold matrices paused frames would not send again
+      pipeline.reset(upload);
+    }
+    if (!pipelined) {
+      simulate(*pipeline.beginWrite());
+      pipeline.publish();
+    }
+
+    TRACE_ZONE_BEGIN(wait, "wait for simulation");
+    const FramePacket* frame = pipeline.beginRead();
+    TRACE_ZONE_END(wait);
+    upload(*frame);
+
+    TRACE_ZONE_BEGIN(submit, "submit");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    state_cache.bindTexture(0, GL_TEXTURE_2D, texture1);
+    state_cache.bindTexture(1, GL_TEXTURE_2D, texture2);
+
+    state_cache.useProgram(shaderProgram.ID);
+    unsigned int viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(frame->view));
+    unsigned int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(frame->projection));
+
+    // render
+    state_cache.bindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)cube.indices.size(), GL_UNSIGNED_INT, 0, (GLsizei)scene.size());
+    TRACE_ZONE_END(submit);
+
+    context.swapBuffers();
+    pipeline.endRead();
+    context.pollEvents();
+
+    if (context.time() - last_report >= 1.0) {
+      const auto stats = pipeline.takeStats();
+      const GLState::Stats state_stats = state_cache.takeStats();
+      std::cout << stats.frames << " fps, " << updated_nodes / stats.frames << " nodes updated; per frame "
+                << stats.simulate_ms << " ms simulating, " << stats.queued_ms << " ms queued, "
+                << stats.render_ms << " ms rendering, " << stats.render_wait_ms << " ms waiting for the simulation, "
+                << stats.latency_ms << " ms from simulation to swap, " << state_stats.filtered / stats.frames
+                << " of " << state_stats.calls / stats.frames << " state calls filtered" << std::endl;
+      last_report = context.time();
+      updated_nodes = 0;
+    }
+  }
+  pipeline.stop();
+  if (simulation.joinable())
+    simulation.join();
+
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  glDeleteBuffers(1, &instanceVBO);
+
+  return 0;
+}
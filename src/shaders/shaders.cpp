@@ -5,47 +5,34 @@
 #include <GLFW/glfw3.h>
 
 #include "Config.h"
+#include "context.h"
+#include "context_tools.h"
+#include "gl_objects.h"
+#include "gl_state.h"
 #include "shader.h"
+#include "trace.h"
 
 
 void resizeWindowCallback(GLFWwindow* window, int width, int height) {
   glViewport(0, 0, width, height);
 }
 
-void processKeyboard(GLFWwindow* window) {
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-    glfwSetWindowShouldClose(window, true);
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
 }
 
-int main() {
+int main(int argc, char** argv) {
   /**
-   * GLFW Initialize
+   * Create the window and its context, or an offscreen one with --headless
    */
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-//  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);  // Debugging
-
-  /**
-   * GLFW window creation
-   */
-  GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
+  ContextOptions options;
+  options.on_demand = true;
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv, options));
+  if (!context.valid())
     return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, resizeWindowCallback);
-
-  /**
-   * GLEW load OpenGL function pointers
-   */
-  if (glewInit() != GLEW_OK) {
-    std::cout << "Failed to initialize GLEW" << std::endl;
-    return -1;
-  }
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
 
   /**
    * Build and compile shader program
@@ -68,19 +55,14 @@ int main() {
     0, 1, 3,  // first triangle
     1, 2, 3   // second triangle
   };
-  unsigned int VBO;   // vertex buffer object (vertices in GPU)
-  unsigned int VAO;   // vertex array object (stores vertex attribute calls)
-  unsigned int EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  GLBuffer VBO;       // vertex buffer object (vertices in GPU)
+  GLVertexArray VAO;  // vertex array object (stores vertex attribute calls)
+  GLBuffer EBO;
 
   glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  VBO.data(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  EBO.data(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
   glEnableVertexAttribArray(0);
@@ -91,26 +73,27 @@ int main() {
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
 
-  while(!glfwWindowShouldClose(window)) {
-    processKeyboard(window);
+  // the render loop binds through the cache, which drops what is still bound from the last frame
+  GLState state_cache;
+
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    TRACE_ZONE_BEGIN(submit, "submit");
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    shaderProgram.use();
+    state_cache.useProgram(shaderProgram.ID);
 
-    glBindVertexArray(VAO);
+    state_cache.bindVertexArray(VAO);
 //    glDrawArrays(GL_TRIANGLES, 0, 6);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    context.countDraws();
+    TRACE_ZONE_END(submit);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    context.swapBuffers();
+    context.pollEvents();
   }
 
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteBuffers(1, &EBO);
-
-  glfwTerminate();
   return 0;
 }
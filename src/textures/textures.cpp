@@ -9,7 +9,12 @@
 #include <thirdparty/stb_image.h>
 
 #include "Config.h"
+#include "context.h"
+#include "context_tools.h"
+#include "gl_objects.h"
+#include "gl_state.h"
 #include "shader.h"
+#include "trace.h"
 
 
 namespace fs = std::experimental::filesystem;
@@ -23,40 +28,22 @@ void resizeWindowCallback(GLFWwindow* window, int width, int height) {
   glViewport(0, 0, w, h);
 }
 
-void processKeyboard(GLFWwindow* window) {
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-    glfwSetWindowShouldClose(window, true);
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
 }
 
-int main() {
+int main(int argc, char** argv) {
   /**
-   * GLFW Initialize
+   * Create the window and its context, or an offscreen one with --headless
    */
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-//  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);  // Debugging
-
-  /**
-   * GLFW window creation
-   */
-  GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
+  ContextOptions options;
+  options.on_demand = true;
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv, options));
+  if (!context.valid())
     return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, resizeWindowCallback);
-
-  /**
-   * GLEW load OpenGL function pointers
-   */
-  if (glewInit() != GLEW_OK) {
-    std::cout << "Failed to initialize GLEW" << std::endl;
-    return -1;
-  }
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
 
   /**
    * Build and compile shader program
@@ -80,19 +67,14 @@ int main() {
     1, 2, 3   // second triangle
   };
 
-  unsigned int VBO;   // vertex buffer object (vertices in GPU)
-  unsigned int VAO;   // vertex array object (stores vertex attribute calls)
-  unsigned int EBO;   // element buffer object
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  GLBuffer VBO;       // vertex buffer object (vertices in GPU)
+  GLVertexArray VAO;  // vertex array object (stores vertex attribute calls)
+  GLBuffer EBO;       // element buffer object
 
   glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  VBO.data(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  EBO.data(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
   // position attribute
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
@@ -108,9 +90,9 @@ int main() {
   /**
    * Set up texture data
    */
-  unsigned int texture1, texture2;
-  glGenTextures(1, &texture1);
+  GLTexture texture1, texture2;
   glBindTexture(GL_TEXTURE_2D, texture1);
+  texture1.label("container.jpg");
   // set the texture wrapping/filteringoptions
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -120,19 +102,22 @@ int main() {
   // load and generate the texture
   int width, height, nrChannels;
   stbi_set_flip_vertically_on_load(true);
+  TRACE_ZONE_BEGIN(decode_container, "decode texture");
   unsigned char *data = stbi_load((texture_dir/"container.jpg").c_str(),
                                   &width, &height, &nrChannels, 0);
+  TRACE_ZONE_END(decode_container);
   if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    TRACE_ZONE("upload texture");
+    texture1.image2D(0, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+    texture1.generateMipmap();
   }
   else {
     std::cerr << "Failed to load texture\n";
   }
   stbi_image_free(data);
 
-  glGenTextures(1, &texture2);
   glBindTexture(GL_TEXTURE_2D, texture2);
+  texture2.label("awesomeface.png");
   // set the texture wrapping/filteringoptions
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -140,10 +125,13 @@ int main() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+  TRACE_ZONE_BEGIN(decode_face, "decode texture");
   data = stbi_load((texture_dir/"awesomeface.png").c_str(), &width, &height, &nrChannels, 0);
+  TRACE_ZONE_END(decode_face);
   if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    TRACE_ZONE("upload texture");
+    texture2.image2D(0, GL_RGBA, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    texture2.generateMipmap();
   }
   else {
     std::cerr << "Failed to load texture\n";
@@ -154,30 +142,29 @@ int main() {
   shaderProgram.setInt("texture1", 1);
   shaderProgram.setInt("texture2", 0);
 
-  while(!glfwWindowShouldClose(window)) {
-    processKeyboard(window);
+  // the render loop binds through the cache, which drops what is still bound from the last frame
+  GLState state_cache;
+
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    TRACE_ZONE_BEGIN(submit, "submit");
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    state_cache.bindTexture(0, GL_TEXTURE_2D, texture1);
+    state_cache.bindTexture(1, GL_TEXTURE_2D, texture2);
 
-    shaderProgram.use();
-    glBindVertexArray(VAO);
+    state_cache.useProgram(shaderProgram.ID);
+    state_cache.bindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    context.countDraws();
+    TRACE_ZONE_END(submit);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    context.swapBuffers();
+    context.pollEvents();
   }
 
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteBuffers(1, &EBO);
-
-  glfwTerminate();
   return 0;
 }
 
@@ -0,0 +1,300 @@
+// A hundred thousand tumbling cubes whose model matrices are composed from structure of
+// arrays transforms straight into a mapped instance buffer on every thread of the job
+// system, or per object with glm (T toggles)
+
+#include <thirdparty/glm/glm.hpp>
+#include <thirdparty/glm/gtc/matrix_transform.hpp>
+#include <thirdparty/glm/gtc/type_ptr.hpp>
+
+#include <chrono>
+#include <cmath>
+#include<experimental/filesystem>
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <thirdparty/stb_image.h>
+
+#include "Config.h"
+#include "bench.h"
+#include "context.h"
+#include "context_tools.h"
+#include "fast_math.h"
+#include "job_system.h"
+#include "mesh.h"
+#include "shader.h"
+#include "texture.h"
+#include "trace.h"
+#include "transform.h"
+
+
+namespace fs = std::experimental::filesystem;
+
+const fs::path shader_dir = fs::path(SHADER_DIR)/"transforms";
+const fs::path texture_dir(TEXTURE_DIR);
+
+const int GRID_SIZE = 316;         // cubes along each side of the grid, about 100k in all
+const float GRID_SPACING = 1.0f;   // distance between neighbouring cubes
+const float CUBE_SCALE = 0.5f;
+const int BENCH_ITERATIONS = 20;
+
+bool soa_transforms = true;
+
+void resizeWindowCallback(GLFWwindow* window, int width, int height) {
+  const int w = std::min(width, 4*height/3);
+  const int h = std::min(height, 3*width/4);
+  glViewport(0, 0, w, h);
+}
+
+void processKeyboard(Context& context) {
+  if (context.keyPressed(GLFW_KEY_ESCAPE))
+    context.setShouldClose();
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+    soa_transforms = !soa_transforms;
+    std::cout << (soa_transforms ? "structure of arrays transforms" : "per object glm transforms") << std::endl;
+  }
+}
+
+
+// rotation of cubes [begin, end) at the given time, written straight into the quaternion arrays
+void animateRotations(TransformArray& transforms, const std::vector<glm::vec3>& axes,
+                      const std::vector<float>& speeds, float time, size_t begin, size_t end) {
+  const size_t BATCH = 256;
+  float half_angles[BATCH], sines[BATCH], cosines[BATCH];
+  float* qx = transforms.component(TransformArray::QX);
+  float* qy = transforms.component(TransformArray::QY);
+  float* qz = transforms.component(TransformArray::QZ);
+  float* qw = transforms.component(TransformArray::QW);
+  for (size_t first = begin; first < end; first += BATCH) {
+    const size_t count = std::min(BATCH, end - first);
+    for (size_t i = 0; i < count; i++)
+      half_angles[i] = 0.5f * speeds[first + i] * time;
+    fastSinCos(half_angles, sines, cosines, count);
+    for (size_t i = 0; i < count; i++) {
+      const size_t cube = first + i;
+      qx[cube] = axes[cube].x * sines[i];
+      qy[cube] = axes[cube].y * sines[i];
+      qz[cube] = axes[cube].z * sines[i];
+      qw[cube] = cosines[i];
+    }
+  }
+}
+
+// the same matrices the way the other samples build them, one object at a time
+void animateModels(std::vector<glm::mat4>& models, const std::vector<glm::vec3>& positions,
+                   const std::vector<glm::vec3>& axes, const std::vector<float>& speeds, float time) {
+  for (size_t i = 0; i < models.size(); i++) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+    model = glm::rotate(model, speeds[i] * time, axes[i]);
+    models[i] = glm::scale(model, glm::vec3(CUBE_SCALE));
+  }
+}
+
+// time composing every model matrix with glm and with each transform kernel the CPU runs
+void runBenchmark(JobSystem& jobs, TransformArray& transforms, const std::vector<glm::vec3>& positions,
+                  const std::vector<glm::vec3>& axes, const std::vector<float>& speeds) {
+  std::vector<glm::mat4> models(transforms.size());
+  std::cout << "model matrices for " << transforms.size() << " objects:" << std::endl;
+  const double glm_ns = measure([&] {
+    animateModels(models, positions, axes, speeds, 1.0f);
+    doNotOptimize(models.data());
+  }, BENCH_ITERATIONS);
+  report("glm per object", glm_ns);
+
+  const std::pair<TransformArray::Kernel, const char*> kernels[] = {
+    {TransformArray::Kernel::Scalar, "structure of arrays, scalar"},
+    {TransformArray::Kernel::SSE, "structure of arrays, SSE"},
+    {TransformArray::Kernel::AVX2, "structure of arrays, AVX2"},
+  };
+  for (const auto& kernel : kernels) {
+    if (kernel.first > TransformArray::bestKernel())
+      continue;
+    const double ns = measure([&] {
+      animateRotations(transforms, axes, speeds, 1.0f, 0, transforms.size());
+      transforms.compose(0, transforms.size(), models.data(), sizeof(glm::mat4), kernel.first);
+      doNotOptimize(models.data());
+    }, BENCH_ITERATIONS);
+    report(kernel.second, ns, glm_ns);
+  }
+  const double threaded_ns = measure([&] {
+    jobs.parallelFor(transforms.size(), [&](size_t begin, size_t end) {
+      animateRotations(transforms, axes, speeds, 1.0f, begin, end);
+      transforms.compose(begin, end - begin, &models[begin]);
+    });
+    doNotOptimize(models.data());
+  }, BENCH_ITERATIONS);
+  report("structure of arrays, " + std::to_string(jobs.threadCount()) + " threads", threaded_ns, glm_ns);
+}
+
+
+int main(int argc, char** argv) {
+  /**
+   * Create the window and its context, or an offscreen one with --headless
+   */
+  Context context(800, 600, "LearnOpenGL", parseContextOptions(argc, argv));
+  if (!context.valid())
+    return -1;
+  ContextTools context_tools(context);
+  context.setFramebufferSizeCallback(resizeWindowCallback);
+  context.setKeyCallback(keyCallback);
+
+  /**
+   * Build and compile shader program
+   */
+  const fs::path vert_shader_path = shader_dir/"transforms.vert";
+  const fs::path frag_shader_path = shader_dir/"transforms.frag";
+  ShaderProgram shaderProgram(vert_shader_path.c_str(), frag_shader_path.c_str());
+
+  /**
+   * Set up the scene: a grid of cubes tumbling about their own axes
+   */
+  const int object_count = GRID_SIZE * GRID_SIZE;
+  std::vector<glm::vec3> positions(object_count), axes(object_count);
+  std::vector<float> speeds(object_count);
+  TransformArray transforms(object_count);
+  for (int i = 0; i < object_count; i++) {
+    positions[i] = GRID_SPACING * glm::vec3(i % GRID_SIZE - GRID_SIZE / 2, 0.0f, -(i / GRID_SIZE));
+    axes[i] = glm::normalize(glm::vec3(std::sin(1.0f * i), 1.0f, std::cos(1.7f * i)));
+    speeds[i] = 0.5f + 0.5f * std::sin(0.3f * i);
+    transforms.setTranslation(i, positions[i]);
+    transforms.setScale(i, glm::vec3(CUBE_SCALE));
+  }
+  std::vector<glm::mat4> models(object_count);
+
+  JobSystem jobs;
+  runBenchmark(jobs, transforms, positions, axes, speeds);
+
+  /**
+   * Set up vertex data and buffers and configure vertex attribues
+   */
+  const Mesh cube = createCube();
+
+  unsigned int VBO;           // vertex buffer object (vertices in GPU)
+  unsigned int EBO;           // element buffer object
+  unsigned int instanceVBO;   // per instance model matrices, rewritten every frame
+  unsigned int VAO;           // vertex array object
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  glGenBuffers(1, &instanceVBO);
+  glGenVertexArrays(1, &VAO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, cube.vertices.size() * sizeof(Vertex), cube.vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, cube.indices.size() * sizeof(uint32_t), cube.indices.data(), GL_STATIC_DRAW);
+
+  // position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // texture coord attribute
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  // model matrix attribute, one column per location, advanced once per instance
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  glBufferData(GL_ARRAY_BUFFER, object_count * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+  for (int column = 0; column < 4; column++) {
+    glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void*)(column * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(2 + column);
+    glVertexAttribDivisor(2 + column, 1);
+  }
+
+  /**
+   * Set up texture data
+   */
+  stbi_set_flip_vertically_on_load(true);
+  GLTexture texture1 = loadTexture(texture_dir/"container.jpg", GL_RGB);
+  GLTexture texture2 = loadTexture(texture_dir/"awesomeface.png", GL_RGBA);
+
+  shaderProgram.use();
+  shaderProgram.setInt("texture1", 1);
+  shaderProgram.setInt("texture2", 0);
+
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+
+  double last_report = context.time();
+  int frames = 0;
+  double update_ms = 0.0;
+  while(!context.shouldClose()) {
+    processKeyboard(context);
+    const float time = (float)context.time();
+
+    // look down the field from above its near edge
+    const glm::vec3 eye(0.0f, 30.0f, 20.0f);
+    const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, -60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 400.0f);
+
+    // fill the instance buffer, either composed in place in the mapped buffer or built per object and copied
+    TRACE_ZONE_BEGIN(update, "update");
+    const auto update_start = std::chrono::steady_clock::now();
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (soa_transforms) {
+      glm::mat4* instances = (glm::mat4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, object_count * sizeof(glm::mat4),
+                                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+      // a map the driver refused is composed into the per object matrices and copied instead
+      glm::mat4* out = instances ? instances : models.data();
+      jobs.parallelFor(object_count, [&](size_t begin, size_t end) {
+        animateRotations(transforms, axes, speeds, time, begin, end);
+        transforms.compose(begin, end - begin, &out[begin]);
+      });
+      if (instances)
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+      else
+        glBufferData(GL_ARRAY_BUFFER, object_count * sizeof(glm::mat4), models.data(), GL_STREAM_DRAW);
+    }
+    else {
+      animateModels(models, positions, axes, speeds, time);
+      glBufferData(GL_ARRAY_BUFFER, object_count * sizeof(glm::mat4), models.data(), GL_STREAM_DRAW);
+    }
+    update_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - update_start).count();
+    TRACE_ZONE_END(update);
+
+    TRACE_ZONE_BEGIN(submit, "submit");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, texture2);
+
+    shaderProgram.use();
+    unsigned int viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    unsigned int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+    // render
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)cube.indices.size(), GL_UNSIGNED_INT, 0, object_count);
+    TRACE_ZONE_END(submit);
+
+    context.swapBuffers();
+    context.pollEvents();
+
+    frames++;
+    if (context.time() - last_report >= 1.0) {
+      std::cout << frames << " fps, " << update_ms / frames << " ms per frame updating "
+                << object_count << " model matrices" << std::endl;
+      last_report = context.time();
+      frames = 0;
+      update_ms = 0.0;
+    }
+  }
+
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  glDeleteBuffers(1, &instanceVBO);
+
+  return 0;
+}